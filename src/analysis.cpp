@@ -0,0 +1,261 @@
+#include <algorithm>
+#include <cmath>
+
+#include "analysis.h"
+#include "defines.h"
+#include "part.h"
+
+static std::vector<StageStats> stageStats;
+static float totalDeltaV = 0;
+static bool isStageStatsDirty = true;
+
+struct StageBurn
+{
+    Part* pEngine;
+    float fuel;
+};
+
+void initPartMass(Part* pPart)
+{
+    auto& partDef = partDefs[pPart->type];
+    pPart->subtreeDryMass = partDef.weight;
+    pPart->subtreeFuel = pPart->liquidFuel + pPart->solidFuel;
+}
+
+static void addToAncestors(Part* pParent, float dryMass, float fuel)
+{
+    for (; pParent; pParent = pParent->pParent)
+    {
+        pParent->subtreeDryMass += dryMass;
+        pParent->subtreeFuel += fuel;
+    }
+}
+
+void onPartAdded(Part* pPart)
+{
+    initPartMass(pPart);
+    addToAncestors(pPart->pParent, pPart->subtreeDryMass, pPart->subtreeFuel);
+    invalidateStageStats();
+}
+
+void onPartRemoving(Part* pPart)
+{
+    addToAncestors(pPart->pParent, -pPart->subtreeDryMass, -pPart->subtreeFuel);
+    invalidateStageStats();
+}
+
+void invalidateStageStats()
+{
+    isStageStatsDirty = true;
+}
+
+static bool isAncestor(Part* pAncestor, Part* pPart)
+{
+    for (; pPart; pPart = pPart->pParent)
+    {
+        if (pPart == pAncestor) return true;
+    }
+    return false;
+}
+
+// Only the staged parts are visited, the rest of the vehicle is summarized
+// by the cached subtree masses. Fuel is assumed burnt before the tanks
+// holding it are decoupled.
+static void updateStageStats()
+{
+    isStageStatsDirty = false;
+    stageStats.assign(stages.size(), StageStats());
+    totalDeltaV = 0;
+    if (!pMainPart) return;
+
+    std::vector<StageBurn> burns;
+    std::vector<Part*> tanks;
+    float mass = pMainPart->subtreeDryMass + pMainPart->subtreeFuel;
+
+    // Last stage in the list fires first
+    for (int i = (int)stages.size() - 1; i >= 0; --i)
+    {
+        auto& stats = stageStats[i];
+        tanks.clear();
+        auto firstBurn = burns.size();
+        for (auto pPart : stages[i])
+        {
+            auto& partDef = partDefs[pPart->type];
+            switch (partDef.type)
+            {
+                case PART_TYPE_BOOSTER:
+                {
+                    stats.thrust += partDef.trust;
+                    stats.burnRate += partDef.burn;
+                    stats.fuel += pPart->solidFuel;
+                    burns.push_back({pPart, pPart->solidFuel});
+                    break;
+                }
+                case PART_TYPE_ENGINE:
+                {
+                    stats.thrust += partDef.trust;
+                    stats.burnRate += partDef.burn;
+                    float liquidFuel = 0;
+                    float maxLiquidFuel = 0;
+                    auto pTank = getLiquidFuel(pPart, liquidFuel, maxLiquidFuel);
+                    if (pTank && std::find(tanks.begin(), tanks.end(), pTank) == tanks.end())
+                    {
+                        tanks.push_back(pTank);
+                        stats.fuel += liquidFuel;
+                        burns.push_back({pPart, liquidFuel});
+                    }
+                    break;
+                }
+                case PART_TYPE_DECOUPLER:
+                {
+                    // Whatever earlier stages burnt from that subtree is already gone
+                    float dropped = pPart->subtreeDryMass + pPart->subtreeFuel;
+                    for (size_t j = 0; j < firstBurn; ++j)
+                    {
+                        if (isAncestor(pPart, burns[j].pEngine)) dropped -= burns[j].fuel;
+                    }
+                    stats.droppedMass += std::max(pPart->subtreeDryMass, dropped);
+                    break;
+                }
+            }
+        }
+
+        mass -= stats.droppedMass;
+        stats.startMass = mass;
+        stats.endMass = std::max(mass - stats.fuel, 0.001f);
+        if (stats.thrust > 0 && stats.burnRate > 0 && stats.fuel > 0 && stats.startMass > 0)
+        {
+            // Exhaust velocity is thrust over mass flow
+            stats.deltaV = (stats.thrust / stats.burnRate) * std::logf(stats.startMass / stats.endMass);
+            stats.twr = stats.thrust / (stats.startMass * GRAVITY);
+            stats.burnTime = stats.fuel / stats.burnRate;
+        }
+        totalDeltaV += stats.deltaV;
+        mass = stats.endMass;
+    }
+}
+
+const std::vector<StageStats>& getStageStats()
+{
+    if (isStageStatsDirty || stageStats.size() != stages.size()) updateStageStats();
+    return stageStats;
+}
+
+float getTotalDeltaV()
+{
+    getStageStats();
+    return totalDeltaV;
+}
+
+// The cached subtreeDryMass is only kept up to date in the editor
+static float getDryMass(Part* pPart)
+{
+    float mass = partDefs[pPart->type].weight;
+    for (auto pChild : pPart->children) mass += getDryMass(pChild);
+    return mass;
+}
+
+static void addActiveBurns(Part* pPart, FlightStage& stage, std::vector<Part*>& tanks, std::vector<StageBurn>& burns)
+{
+    auto& partDef = partDefs[pPart->type];
+    if (pPart->isActive)
+    {
+        if (partDef.type == PART_TYPE_BOOSTER && pPart->solidFuel > 0)
+        {
+            stage.thrust += partDef.trust;
+            stage.burnRate += partDef.burn;
+            stage.fuel += pPart->solidFuel;
+            burns.push_back({pPart, pPart->solidFuel});
+        }
+        else if (partDef.type == PART_TYPE_ENGINE)
+        {
+            float liquidFuel = 0;
+            float maxLiquidFuel = 0;
+            auto pTank = getLiquidFuel(pPart, liquidFuel, maxLiquidFuel);
+            if (pTank)
+            {
+                stage.thrust += partDef.trust;
+                stage.burnRate += partDef.burn;
+                if (std::find(tanks.begin(), tanks.end(), pTank) == tanks.end())
+                {
+                    tanks.push_back(pTank);
+                    stage.fuel += liquidFuel;
+                    burns.push_back({pPart, liquidFuel});
+                }
+            }
+        }
+    }
+    for (auto pChild : pPart->children) addActiveBurns(pChild, stage, tanks, burns);
+}
+
+// Everything already lit burns as one stage, then the stages left on the
+// stack fire in order as soon as the previous one runs dry.
+void buildFlightModel(Part* pRoot, FlightState& state, std::vector<FlightStage>& flightStages)
+{
+    flightStages.clear();
+    state = FlightState();
+    if (!pRoot) return;
+
+    std::vector<Part*> tanks;
+    std::vector<StageBurn> burns;
+    FlightStage current = {0, 0, 0, 0};
+    addActiveBurns(pRoot, current, tanks, burns);
+    flightStages.push_back(current);
+
+    for (int i = (int)stages.size() - 2; i >= 0; --i)
+    {
+        FlightStage stage = {0, 0, 0, 0};
+        tanks.clear();
+        auto firstBurn = burns.size();
+        for (auto pPart : stages[i])
+        {
+            if (getTopParent(pPart) != pRoot) continue;
+            auto& partDef = partDefs[pPart->type];
+            switch (partDef.type)
+            {
+                case PART_TYPE_BOOSTER:
+                {
+                    stage.thrust += partDef.trust;
+                    stage.burnRate += partDef.burn;
+                    stage.fuel += pPart->solidFuel;
+                    burns.push_back({pPart, pPart->solidFuel});
+                    break;
+                }
+                case PART_TYPE_ENGINE:
+                {
+                    float liquidFuel = 0;
+                    float maxLiquidFuel = 0;
+                    auto pTank = getLiquidFuel(pPart, liquidFuel, maxLiquidFuel);
+                    stage.thrust += partDef.trust;
+                    stage.burnRate += partDef.burn;
+                    if (pTank && std::find(tanks.begin(), tanks.end(), pTank) == tanks.end())
+                    {
+                        tanks.push_back(pTank);
+                        stage.fuel += liquidFuel;
+                        burns.push_back({pPart, liquidFuel});
+                    }
+                    break;
+                }
+                case PART_TYPE_DECOUPLER:
+                {
+                    // Same as updateStageStats, earlier stages already burnt part of it
+                    float dropped = getTotalMass(pPart);
+                    for (size_t j = 0; j < firstBurn; ++j)
+                    {
+                        if (isAncestor(pPart, burns[j].pEngine)) dropped -= burns[j].fuel;
+                    }
+                    stage.droppedMass += std::max(getDryMass(pPart), dropped);
+                    break;
+                }
+            }
+        }
+        flightStages.push_back(stage);
+    }
+
+    state.x = pRoot->position.x;
+    state.y = pRoot->position.y;
+    state.vx = pRoot->vel.x;
+    state.vy = pRoot->vel.y;
+    state.pitch = getPitch(state.x, state.y, pRoot->angle);
+    state.mass = getTotalMass(pRoot);
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <vector>
+
+#include "flightmodel.h"
+
+struct Part;
+
+// Performance of one stage, in the same order as stages
+struct StageStats
+{
+    float thrust = 0;
+    float burnRate = 0;     // Fuel mass per second
+    float fuel = 0;         // Fuel the stage's engines can reach
+    float droppedMass = 0;  // Mass decoupled when the stage fires
+    float startMass = 0;
+    float endMass = 0;
+    float deltaV = 0;
+    float twr = 0;
+    float burnTime = 0;
+};
+
+// Keep Part::subtreeDryMass/subtreeFuel up to date while editing
+void initPartMass(Part* pPart);
+void onPartAdded(Part* pPart);
+void onPartRemoving(Part* pPart);
+
+void invalidateStageStats();
+const std::vector<StageStats>& getStageStats();
+float getTotalDeltaV();
+
+// Live vehicle in flight, reduced to a point mass and its remaining burns.
+// The state still needs initFlightState.
+void buildFlightModel(Part* pRoot, FlightState& state, std::vector<FlightStage>& flightStages);
@@ -0,0 +1,169 @@
+#include <onut/Timing.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "analysis.h"
+#include "autopilot.h"
+#include "defines.h"
+#include "jobs.h"
+#include "part.h"
+#include "physics.h"
+
+#define AUTOPILOT_REPLAN_INTERVAL 5         // Ticks between plans
+#define AUTOPILOT_SWITCH_TIME 20.0f         // When a plan goes from its first to second pitch
+#define AUTOPILOT_STEP_BUDGET 256           // Simulation steps per candidate, the only limit
+#define AUTOPILOT_ORBIT_MARGIN 500.0f
+
+static const float FIRST_PITCHES[] = {-1.4f, -1.0f, -.6f, -.25f, 0.0f, .25f, .6f, 1.0f, 1.4f};
+static const float SECOND_PITCHES[] = {-1.57f, -1.2f, 1.2f, 1.57f};
+static const float STAGE_HOLDS[] = {0.0f, 15.0f};
+
+#define FIRST_PITCH_COUNT (sizeof(FIRST_PITCHES) / sizeof(float))
+#define SECOND_PITCH_COUNT (sizeof(SECOND_PITCHES) / sizeof(float))
+#define STAGE_HOLD_COUNT (sizeof(STAGE_HOLDS) / sizeof(float))
+#define AUTOPILOT_CANDIDATES (FIRST_PITCH_COUNT * SECOND_PITCH_COUNT * STAGE_HOLD_COUNT + 1)
+
+struct AutopilotPlan
+{
+    float firstPitch;
+    float secondPitch;
+    float stageHold;
+    float score;
+};
+
+bool isAutopilotOn = false;
+
+static const AutopilotPlan DEFAULT_PLAN = {0, 1.57f, 0, 0};
+static AutopilotPlan currentPlan = DEFAULT_PLAN;
+static float planTime = 0;
+static int replanTicks = 0;
+
+extern bool hasStableOrbit;
+void activateNextStage();
+
+void toggleAutopilot()
+{
+    isAutopilotOn = !isAutopilotOn;
+    replanTicks = 0;
+    planTime = 0;
+}
+
+void resetAutopilot()
+{
+    isAutopilotOn = false;
+    currentPlan = DEFAULT_PLAN;
+    replanTicks = 0;
+    planTime = 0;
+}
+
+// How close the resulting orbit's low point is to clearing the atmosphere.
+// Uses the same epicycle approximation as the satellite catalog.
+static float scoreFlight(const FlightState& state, float targetRadius)
+{
+    if (state.crashed) return -1e9f + state.time;
+    float radius = std::sqrtf(state.x * state.x + state.y * state.y);
+    float upX = state.x / radius;
+    float upY = state.y / radius;
+    float radialVel = state.vx * upX + state.vy * upY;
+    float tangentialVel = upX * state.vy - upY * state.vx;
+    float angularMomentum = radius * tangentialVel;
+    float guideRadius = std::cbrtf(angularMomentum * angularMomentum / GRAVITY);
+    if (guideRadius <= 0) return -1e6f + radius;
+    float epicycleRate = std::sqrtf(3.0f) * std::fabsf(angularMomentum) / (guideRadius * guideRadius);
+    float dr = radius - guideRadius;
+    float amplitude = std::sqrtf(dr * dr + (radialVel / epicycleRate) * (radialVel / epicycleRate));
+    float periapsis = guideRadius - amplitude;
+
+    // Reach the target first, then save fuel
+    return std::min(periapsis, targetRadius) + state.fuel * .01f - (float)state.stage * 10.0f;
+}
+
+static AutopilotPlan getCandidate(int index)
+{
+    if (index == 0) return currentPlan; // Warm start
+    --index;
+    AutopilotPlan plan;
+    plan.stageHold = STAGE_HOLDS[index % STAGE_HOLD_COUNT];
+    index /= STAGE_HOLD_COUNT;
+    plan.secondPitch = SECOND_PITCHES[index % SECOND_PITCH_COUNT];
+    index /= SECOND_PITCH_COUNT;
+    plan.firstPitch = FIRST_PITCHES[index];
+    plan.score = 0;
+    return plan;
+}
+
+static void plan()
+{
+    FlightState state;
+    std::vector<FlightStage> flightStages;
+    buildFlightModel(pMainPart, state, flightStages);
+    auto pStages = flightStages.data();
+    int stageCount = (int)flightStages.size();
+    FlightWorld world = {GRAVITY, (float)PLANET_SIZE};
+    float targetRadius = getSpaceDistance() + AUTOPILOT_ORBIT_MARGIN;
+
+    // Every candidate always runs its full step budget, no wall clock limit,
+    // so the same state always picks the same plan whatever the load
+    std::vector<AutopilotPlan> candidates(AUTOPILOT_CANDIDATES);
+    parallelFor((int)AUTOPILOT_CANDIDATES, [&](int index)
+    {
+        auto candidate = getCandidate(index);
+        auto simState = state;
+        simState.stageHold = candidate.stageHold;
+        initFlightState(simState, pStages, stageCount);
+        for (int step = 0; step < AUTOPILOT_STEP_BUDGET && !simState.crashed; ++step)
+        {
+            simState.pitch = simState.time < AUTOPILOT_SWITCH_TIME ? candidate.firstPitch : candidate.secondPitch;
+            stepFlight(world, simState, pStages, stageCount, getFlightStepSize(simState, pStages, stageCount));
+        }
+        candidate.score = scoreFlight(simState, targetRadius);
+        candidates[index] = candidate;
+    });
+
+    // Ties go to the lowest index, the previous plan first
+    int best = 0;
+    for (int i = 1; i < (int)candidates.size(); ++i)
+    {
+        if (candidates[i].score > candidates[best].score) best = i;
+    }
+    currentPlan = candidates[best];
+    planTime = 0;
+
+    // Staging: nothing burning and the plan doesn't want to coast
+    bool isBurning = stageCount && pStages[0].fuel > 0 && pStages[0].thrust > 0;
+    if (!isBurning)
+    {
+        bool isPayloadNext = stages.size() == 2;
+        if (isPayloadNext ? hasStableOrbit : (stages.size() > 2 && currentPlan.stageHold <= 0))
+        {
+            activateNextStage();
+        }
+    }
+}
+
+static void steer(float targetPitch)
+{
+    auto currentPitch = getPitch(pMainPart->position.x, pMainPart->position.y, pMainPart->angle);
+    auto error = std::remainderf(targetPitch - currentPitch, DirectX::XM_2PI);
+
+    // Same torque the player has with the arrow keys
+    auto authority = (10 + getTotalStability(pMainPart) * 4) / getTotalMass(pMainPart) * ODT;
+    auto desiredRate = std::max(-1.0f, std::min(1.0f, error * 2.0f));
+    auto rateChange = std::max(-authority, std::min(authority, desiredRate - pMainPart->angleVelocity));
+    pMainPart->angleVelocity += rateChange;
+}
+
+void updateAutopilot()
+{
+    if (!isAutopilotOn || !pMainPart) return;
+    if (replanTicks-- <= 0)
+    {
+        replanTicks = AUTOPILOT_REPLAN_INTERVAL;
+        plan();
+        if (!pMainPart) return;
+    }
+    planTime += ODT;
+    steer(planTime < AUTOPILOT_SWITCH_TIME ? currentPlan.firstPitch : currentPlan.secondPitch);
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+// Model predictive ascent: every few ticks, many short look-ahead flights
+// of the current vehicle are run in parallel with different pitch programs
+// and staging holds, and the best one is flown.
+extern bool isAutopilotOn;
+
+void toggleAutopilot();
+void resetAutopilot(); // Off with no plan, for every new or restored flight
+void updateAutopilot();
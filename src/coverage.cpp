@@ -0,0 +1,204 @@
+#include <onut/Maths.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define COVERAGE_SSE2
+#endif
+
+#include "coverage.h"
+#include "defines.h"
+#include "satellites.h"
+
+#define COVERAGE_BINS_PER_RADIAN ((float)COVERAGE_BINS / DirectX::XM_2PI)
+
+static int wordsPerBin = 0;
+static std::vector<uint64_t> coverageBits; // COVERAGE_BINS rows of wordsPerBin words
+static std::vector<uint32_t> coverageCounts; // Satellites seeing each bin
+static int coveredBins = 0;
+
+// Arc of bins each satellite currently has marked, and the one it should have
+static std::vector<int> arcStart;
+static std::vector<int> arcLength;
+static std::vector<int> newArcStart;
+static std::vector<int> newArcLength;
+static std::vector<float> horizonAngle;
+
+static void growCoverage(int satelliteCount)
+{
+    int newWordsPerBin = (satelliteCount + 63) / 64;
+    if (newWordsPerBin > wordsPerBin)
+    {
+        // Keep some room so we don't restride on every launch
+        newWordsPerBin = std::max(newWordsPerBin, wordsPerBin * 2);
+        std::vector<uint64_t> newBits((size_t)COVERAGE_BINS * newWordsPerBin, 0);
+        for (int bin = 0; bin < COVERAGE_BINS && wordsPerBin; ++bin)
+        {
+            std::copy(coverageBits.begin() + (size_t)bin * wordsPerBin,
+                      coverageBits.begin() + (size_t)(bin + 1) * wordsPerBin,
+                      newBits.begin() + (size_t)bin * newWordsPerBin);
+        }
+        coverageBits.swap(newBits);
+        wordsPerBin = newWordsPerBin;
+    }
+    if (coverageCounts.empty()) coverageCounts.resize(COVERAGE_BINS, 0);
+    arcStart.resize(satelliteCount, 0);
+    arcLength.resize(satelliteCount, 0);
+    newArcStart.resize(satelliteCount);
+    newArcLength.resize(satelliteCount);
+    horizonAngle.resize(satelliteCount);
+}
+
+// From the satellite position, the visible surface is every point within
+// acos(R / r) of the point right under it. Anything further is behind the
+// planet's horizon.
+static void computeArcs(int count)
+{
+    auto& catalog = satelliteCatalog;
+    const float* __restrict radius = catalog.radius.data();
+    const float* __restrict angle = catalog.angle.data();
+    float* __restrict horizon = horizonAngle.data();
+    int* __restrict start = newArcStart.data();
+    int* __restrict length = newArcLength.data();
+
+    for (int i = 0; i < count; ++i)
+    {
+        horizon[i] = std::acosf(std::min(1.0f, (float)PLANET_SIZE / radius[i]));
+    }
+
+    // Offset keeps everything positive so truncation is a floor
+    const float offset = (float)(COVERAGE_BINS * 2);
+    int i = 0;
+#if defined(COVERAGE_SSE2)
+    const __m128 binsPerRadian = _mm_set1_ps(COVERAGE_BINS_PER_RADIAN);
+    const __m128 offset4 = _mm_set1_ps(offset);
+    const __m128i mask = _mm_set1_epi32(COVERAGE_BINS - 1);
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i maxLength = _mm_set1_epi32(COVERAGE_BINS);
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 a = _mm_loadu_ps(angle + i);
+        __m128 h = _mm_loadu_ps(horizon + i);
+        __m128 lo = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(a, h), binsPerRadian), offset4);
+        __m128 hi = _mm_add_ps(_mm_mul_ps(_mm_add_ps(a, h), binsPerRadian), offset4);
+        __m128i first = _mm_cvttps_epi32(lo);
+        __m128i last = _mm_cvttps_epi32(hi);
+        __m128i len = _mm_add_epi32(_mm_sub_epi32(last, first), one);
+        // min(len, COVERAGE_BINS), SSE2 has no 32 bits integer min
+        __m128i tooLong = _mm_cmpgt_epi32(len, maxLength);
+        len = _mm_or_si128(_mm_and_si128(tooLong, maxLength), _mm_andnot_si128(tooLong, len));
+        _mm_storeu_si128((__m128i*)(start + i), _mm_and_si128(first, mask));
+        _mm_storeu_si128((__m128i*)(length + i), len);
+    }
+#endif
+    for (; i < count; ++i)
+    {
+        int first = (int)((angle[i] - horizon[i]) * COVERAGE_BINS_PER_RADIAN + offset);
+        int last = (int)((angle[i] + horizon[i]) * COVERAGE_BINS_PER_RADIAN + offset);
+        start[i] = first & (COVERAGE_BINS - 1);
+        length[i] = std::min(last - first + 1, COVERAGE_BINS);
+    }
+}
+
+static void setBits(int satellite, int from, int to)
+{
+    auto word = satellite >> 6;
+    auto bit = 1ull << (satellite & 63);
+    for (int b = from; b < to; ++b)
+    {
+        int bin = b & (COVERAGE_BINS - 1);
+        coverageBits[(size_t)bin * wordsPerBin + word] |= bit;
+        if (coverageCounts[bin]++ == 0) ++coveredBins;
+    }
+}
+
+static void clearBits(int satellite, int from, int to)
+{
+    auto word = satellite >> 6;
+    auto bit = 1ull << (satellite & 63);
+    for (int b = from; b < to; ++b)
+    {
+        int bin = b & (COVERAGE_BINS - 1);
+        coverageBits[(size_t)bin * wordsPerBin + word] &= ~bit;
+        if (--coverageCounts[bin] == 0) --coveredBins;
+    }
+}
+
+// Calls fn on the (at most two) runs of bins that are in arc A but not in
+// arc B. Runs are expressed relative to B's start, unwrapped.
+template<typename Fn>
+static void forEachArcDifference(int startA, int lengthA, int startB, int lengthB, Fn fn)
+{
+    int o = (startA - startB) & (COVERAGE_BINS - 1);
+    int from = std::max(o, lengthB);
+    int to = std::min(o + lengthA, COVERAGE_BINS);
+    if (from < to) fn(startB + from, startB + to);
+    from = std::max(o, COVERAGE_BINS + lengthB);
+    to = o + lengthA;
+    if (from < to) fn(startB + from, startB + to);
+}
+
+void updateCoverage()
+{
+    int count = satelliteCatalog.size();
+    if (!count) return;
+    if (count > (int)arcStart.size()) growCoverage(count);
+
+    computeArcs(count);
+
+    // Orbits move a bin or two per frame at most, only touch the edges
+    for (int i = 0; i < count; ++i)
+    {
+        int oldStart = arcStart[i];
+        int oldLength = arcLength[i];
+        int newStart = newArcStart[i];
+        int newLength = newArcLength[i];
+        if (oldStart == newStart && oldLength == newLength) continue;
+        forEachArcDifference(oldStart, oldLength, newStart, newLength, [i](int from, int to)
+        {
+            clearBits(i, from, to);
+        });
+        forEachArcDifference(newStart, newLength, oldStart, oldLength, [i](int from, int to)
+        {
+            setBits(i, from, to);
+        });
+        arcStart[i] = newStart;
+        arcLength[i] = newLength;
+    }
+}
+
+void truncateCoverage(int count)
+{
+    for (int i = std::max(0, count); i < (int)arcStart.size(); ++i)
+    {
+        clearBits(i, arcStart[i], arcStart[i] + arcLength[i]);
+        arcStart[i] = 0;
+        arcLength[i] = 0;
+    }
+}
+
+float getCoveragePercent()
+{
+    return (float)coveredBins * 100.0f / (float)COVERAGE_BINS;
+}
+
+int getCoveringSatelliteCount(int bin)
+{
+    if (coverageCounts.empty()) return 0;
+    return (int)coverageCounts[bin & (COVERAGE_BINS - 1)];
+}
+
+bool isBinCoveredBy(int bin, int satellite)
+{
+    if (satellite < 0 || satellite >= (int)arcStart.size()) return false;
+    bin &= COVERAGE_BINS - 1;
+    return (coverageBits[(size_t)bin * wordsPerBin + (satellite >> 6)] >> (satellite & 63)) & 1;
+}
+
+int getCoverageBin(float angle)
+{
+    return (int)(angle * COVERAGE_BINS_PER_RADIAN + (float)(COVERAGE_BINS * 2)) & (COVERAGE_BINS - 1);
+}
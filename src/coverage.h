@@ -0,0 +1,13 @@
+#pragma once
+#include <cstdint>
+
+// The planet surface is split in angular bins. Every bin keeps a bitset of
+// the cataloged satellites that have line of sight to it.
+#define COVERAGE_BINS 1024 // Must be a power of 2
+
+void updateCoverage();
+void truncateCoverage(int count); // Satellites from count on are gone
+float getCoveragePercent();
+int getCoveringSatelliteCount(int bin);
+bool isBinCoveredBy(int bin, int satellite);
+int getCoverageBin(float angle);
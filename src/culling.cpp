@@ -0,0 +1,26 @@
+#include <onut/Renderer.h>
+
+#include "culling.h"
+
+CullStats cullStats;
+
+void resetCullStats()
+{
+    cullStats = CullStats();
+}
+
+Rect getCameraRect()
+{
+    extern Vector2 cameraPos;
+    extern float zoom;
+    Vector2 size(OScreenWf / zoom, OScreenHf / zoom);
+    return Rect(cameraPos - size * .5f, size);
+}
+
+bool isCircleInRect(const Rect& rect, const Vector2& center, float radius)
+{
+    return center.x + radius >= rect.x &&
+           center.y + radius >= rect.y &&
+           center.x - radius <= rect.x + rect.z &&
+           center.y - radius <= rect.y + rect.w;
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include <onut/Maths.h>
+
+// What got submitted and skipped during the last rendered frame
+struct CullStats
+{
+    int vehiclesDrawn = 0;
+    int vehiclesCulled = 0;
+    int particlesDrawn = 0;
+    int particlesCulled = 0;
+};
+
+extern CullStats cullStats;
+
+void resetCullStats();
+Rect getCameraRect(); // World area seen through set2DCameraOffCenter(cameraPos, zoom)
+bool isCircleInRect(const Rect& rect, const Vector2& center, float radius);
@@ -1,19 +1,16 @@
 #pragma once
 #include <onut/Maths.h>
 
-#define PLANET_SIZE 10000
+#include "physics.h"
+
 #define PLANET_SIDES 360
 #define ZOOM 60
-#define ATMOSPHERES_COUNT 4
-#define ATMOSPHERES_SCALE 0.05f
 #define STAR_COUNT 300
 
 #define GAME_STATE_EDITOR 0
 #define GAME_STATE_STAND_BY 1
 #define GAME_STATE_FLIGHT 2
 
-#define GRAVITY 3.0f
-
 static const Color PLANET_COLOR = Color(0, .5f, 0, 1).AdjustedSaturation(.5f);
 static const Color ATMOSPHERE_BASE_COLOR = Color(0, .75f, 1, 1).AdjustedSaturation(.5f);
 static const Color ATMOSPHERE_COLORS[ATMOSPHERES_COUNT + 1] = {
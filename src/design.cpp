@@ -0,0 +1,241 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <unordered_map>
+#include <vector>
+
+#include "defines.h"
+#include "design.h"
+#include "part.h"
+
+#define FLIGHT_RESULTS_FILE "flights.dat"
+#define FLIGHT_RESULTS_MAGIC 0x464A4F4A // "OJFF"
+#define FLIGHT_RESULTS_VERSION 1
+
+#define FNV_OFFSET 14695981039346656037ull
+#define FNV_PRIME 1099511628211ull
+
+static std::unordered_map<uint64_t, FlightResult> flightResults;
+static std::vector<int> mirroredTypes;
+
+static FlightResult currentFlight;
+static bool isRecordingFlight = false;
+static float initialFuel = 0;
+
+static uint64_t hashBytes(uint64_t hash, const void* pData, size_t size)
+{
+    auto pBytes = (const uint8_t*)pData;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= pBytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+template<typename T>
+static uint64_t hashValue(uint64_t hash, const T& value)
+{
+    return hashBytes(hash, &value, sizeof(T));
+}
+
+uint64_t getCatalogVersion()
+{
+    static uint64_t version = 0;
+    if (version) return version;
+    uint64_t hash = FNV_OFFSET;
+    for (auto& partDef : partDefs)
+    {
+        hash = hashValue(hash, partDef.id);
+        hash = hashValue(hash, partDef.type);
+        hash = hashValue(hash, partDef.weight);
+        hash = hashValue(hash, partDef.liquidFuel);
+        hash = hashValue(hash, partDef.solidFuel);
+        hash = hashValue(hash, partDef.stability);
+        hash = hashValue(hash, partDef.trust);
+        hash = hashValue(hash, partDef.burn);
+        hash = hashValue(hash, partDef.isStaged);
+        for (auto& attachPoint : partDef.attachPoints) hash = hashValue(hash, attachPoint);
+        for (auto dir : partDef.attachPointsDir) hash = hashValue(hash, dir);
+    }
+    version = hash;
+    return version;
+}
+
+// Left and right versions of a part (fins, side decouplers) share
+// everything except mirrored attach points.
+static int getMirroredType(int type)
+{
+    if (mirroredTypes.empty())
+    {
+        for (int i = 0; i < (int)partDefs.size(); ++i)
+        {
+            auto& partDef = partDefs[i];
+            int mirrored = i;
+            for (int j = 0; j < (int)partDefs.size() && mirrored == i; ++j)
+            {
+                auto& other = partDefs[j];
+                if (i == j ||
+                    other.type != partDef.type ||
+                    other.weight != partDef.weight ||
+                    other.attachPoints.size() != partDef.attachPoints.size())
+                {
+                    continue;
+                }
+                bool isMirror = true;
+                for (auto& attachPoint : partDef.attachPoints)
+                {
+                    bool found = false;
+                    for (auto& otherAttachPoint : other.attachPoints)
+                    {
+                        if (std::fabsf(otherAttachPoint.x + attachPoint.x) < .01f &&
+                            std::fabsf(otherAttachPoint.y - attachPoint.y) < .01f)
+                        {
+                            found = true;
+                            break;
+                        }
+                    }
+                    if (!found)
+                    {
+                        isMirror = false;
+                        break;
+                    }
+                }
+                if (isMirror) mirrored = j;
+            }
+            mirroredTypes.push_back(mirrored);
+        }
+    }
+    return mirroredTypes[type];
+}
+
+// Child order doesn't matter, so children hashes are sorted before being
+// combined. Positions are quantized to texture pixels so float noise from
+// the editor doesn't change the hash.
+static uint64_t hashPart(Part* pPart, bool mirrored, const std::unordered_map<Part*, int>& stageOf)
+{
+    uint64_t hash = FNV_OFFSET;
+    int type = mirrored ? getMirroredType(pPart->type) : pPart->type;
+    int x = (int)std::roundf(pPart->position.x * 64.0f) * (mirrored ? -1 : 1);
+    int y = (int)std::roundf(pPart->position.y * 64.0f);
+    auto it = stageOf.find(pPart);
+    int stage = it == stageOf.end() ? -1 : it->second;
+    hash = hashValue(hash, type);
+    hash = hashValue(hash, x);
+    hash = hashValue(hash, y);
+    hash = hashValue(hash, stage);
+
+    std::vector<uint64_t> childHashes;
+    childHashes.reserve(pPart->children.size());
+    for (auto pChild : pPart->children)
+    {
+        childHashes.push_back(hashPart(pChild, mirrored, stageOf));
+    }
+    std::sort(childHashes.begin(), childHashes.end());
+    for (auto childHash : childHashes) hash = hashValue(hash, childHash);
+    return hash;
+}
+
+uint64_t getDesignHash(Part* pRoot)
+{
+    if (!pRoot) return 0;
+    std::unordered_map<Part*, int> stageOf;
+    for (int i = 0; i < (int)stages.size(); ++i)
+    {
+        for (auto pPart : stages[i]) stageOf[pPart] = i;
+    }
+    // A design and its mirror image fly the same
+    auto hash = hashPart(pRoot, false, stageOf);
+    auto mirroredHash = hashPart(pRoot, true, stageOf);
+    return std::min(hash, mirroredHash);
+}
+
+static uint64_t getResultKey(uint64_t designHash, uint64_t catalogVersion)
+{
+    return hashValue(hashValue(FNV_OFFSET, designHash), catalogVersion);
+}
+
+void loadFlightResults()
+{
+    std::ifstream file(FLIGHT_RESULTS_FILE, std::ios::binary);
+    if (!file.is_open()) return;
+
+    uint32_t header[2] = {0};
+    file.read((char*)header, sizeof(header));
+    if (!file ||
+        header[0] != FLIGHT_RESULTS_MAGIC ||
+        header[1] != FLIGHT_RESULTS_VERSION)
+    {
+        return;
+    }
+
+    // Append only, later records win
+    FlightResult result;
+    while (file.read((char*)&result, sizeof(result)))
+    {
+        flightResults[getResultKey(result.designHash, result.catalogVersion)] = result;
+    }
+}
+
+bool findFlightResult(uint64_t designHash, FlightResult& result)
+{
+    auto it = flightResults.find(getResultKey(designHash, getCatalogVersion()));
+    if (it == flightResults.end()) return false;
+    result = it->second;
+    return true;
+}
+
+void recordFlightResult(const FlightResult& result)
+{
+    flightResults[getResultKey(result.designHash, result.catalogVersion)] = result;
+
+    bool isNew = !std::ifstream(FLIGHT_RESULTS_FILE).good();
+    std::ofstream file(FLIGHT_RESULTS_FILE, std::ios::binary | std::ios::app);
+    if (!file.is_open()) return;
+    if (isNew)
+    {
+        uint32_t header[2] = {FLIGHT_RESULTS_MAGIC, FLIGHT_RESULTS_VERSION};
+        file.write((const char*)header, sizeof(header));
+    }
+    file.write((const char*)&result, sizeof(result));
+}
+
+static float getTotalFuel(Part* pPart)
+{
+    float ret = pPart->liquidFuel + pPart->solidFuel;
+    for (auto pChild : pPart->children) ret += getTotalFuel(pChild);
+    return ret;
+}
+
+void beginFlightRecord(Part* pRoot)
+{
+    currentFlight = FlightResult();
+    currentFlight.designHash = getDesignHash(pRoot);
+    currentFlight.catalogVersion = getCatalogVersion();
+    initialFuel = pRoot ? getTotalFuel(pRoot) : 0;
+    isRecordingFlight = pRoot != nullptr;
+}
+
+void updateFlightRecord(float deltaV)
+{
+    if (!isRecordingFlight) return;
+    extern bool hasStableOrbit;
+    currentFlight.deltaV += deltaV;
+    currentFlight.reachedOrbit |= hasStableOrbit;
+}
+
+void cancelFlightRecord()
+{
+    isRecordingFlight = false;
+}
+
+void endFlightRecord()
+{
+    if (!isRecordingFlight) return;
+    isRecordingFlight = false;
+    if (pMainPart && initialFuel > 0)
+    {
+        currentFlight.fuelMargin = getTotalFuel(getTopParent(pMainPart)) / initialFuel;
+    }
+    recordFlightResult(currentFlight);
+}
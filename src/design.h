@@ -0,0 +1,27 @@
+#pragma once
+#include <cstdint>
+
+struct Part;
+
+// Result of flying a design, cached on disk by design hash + catalog version
+struct FlightResult
+{
+    uint64_t designHash = 0;
+    uint64_t catalogVersion = 0;
+    bool reachedOrbit = false;
+    float deltaV = 0;       // Delta-v spent by the vehicle carrying the payload
+    float fuelMargin = 0;   // Fuel left on that vehicle, 0 to 1
+};
+
+uint64_t getCatalogVersion();
+uint64_t getDesignHash(Part* pRoot);
+
+void loadFlightResults();
+bool findFlightResult(uint64_t designHash, FlightResult& result);
+void recordFlightResult(const FlightResult& result);
+
+// Measures the flight in progress
+void beginFlightRecord(Part* pRoot);
+void updateFlightRecord(float deltaV);
+void cancelFlightRecord();
+void endFlightRecord();
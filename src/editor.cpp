@@ -4,10 +4,15 @@
 #include <onut/SpriteBatch.h>
 #include <onut/Sound.h>
 
+#include "analysis.h"
+#include "design.h"
 #include "editor.h"
 #include "defines.h"
 #include "meshes.h"
 #include "part.h"
+#include "textcache.h"
+#include "renderqueue.h"
+#include "vehiclemesh.h"
 
 float scrollPos = 0;
 float scrollTarget = 0;
@@ -27,11 +32,21 @@ bool isPanning = false;
 Vector2 camPosOnDown;
 bool isHoldingValid = false;
 
+bool isDesignKnown = false;
+FlightResult knownResult;
+
 #define SCROLL_VIEW_W 150
 #define SNAP_DIST 0.25f * 0.25f
 
 extern OFontRef g_pFont;
 
+void onDesignChanged()
+{
+    invalidateStageStats();
+    invalidateVehicleMeshes();
+    isDesignKnown = findFlightResult(getDesignHash(pMainPart), knownResult);
+}
+
 void resetEditor()
 {
     scrollPos = 0;
@@ -52,10 +67,12 @@ void resetEditor()
     pMainPart = new Part();
     pMainPart->angle = 0;
     pMainPart->type = 0;
+    initPartMass(pMainPart);
     parts.push_back(pMainPart);
 
     stages.clear();
     stages.push_back({pMainPart});
+    onDesignChanged();
 }
 
 void doPanningZoom()
@@ -237,6 +254,7 @@ void updateEditor(float dt)
                 pPart->parentAttachPoint = targetAttachPoint;
                 pTargetPart->usedAttachPoints.insert(targetAttachPoint);
                 pTargetPart->children.push_back(pPart);
+                onPartAdded(pPart);
                 holdingPart = -1;
 
                 if (partDef.isStaged)
@@ -245,6 +263,7 @@ void updateEditor(float dt)
                     stages.push_back({pPart});
                 }
 
+                onDesignChanged();
                 OPlayRandomSound({"Build_AddPart01.wav", "Build_AddPart02.wav", "Build_AddPart03.wav", "Build_AddPart04.wav"});
             }
         }
@@ -302,6 +321,7 @@ void updateEditor(float dt)
                 stages[stageIndex].push_back(pHoverPart);
             }
             trimStages();
+            onDesignChanged();
         }
         else if (OInputJustPressed(OKeyUp))
         {
@@ -336,13 +356,16 @@ void updateEditor(float dt)
                 stages[stageIndex].push_back(pHoverPart);
             }
             trimStages();
+            onDesignChanged();
         }
         else if (OInputJustPressed(OKeyDelete))
         {
             if (pHoverPart != pMainPart)
             {
+                onPartRemoving(pHoverPart);
                 deletePart(pHoverPart);
                 pHoverPart = nullptr;
+                onDesignChanged();
                 OPlaySound("Build_RemovePart.wav");
             }
         }
@@ -358,8 +381,9 @@ void drawEditor()
 
     // Draw rocket view
     auto partTransform = Matrix::CreateTranslation(editorCamPos) * Matrix::CreateScale(ZOOM_LEVELS[editorZoom]) * Matrix::CreateTranslation((OScreenWf - SCROLL_VIEW_W) / 2 + SCROLL_VIEW_W, OScreenHf / 2, 0);
+    drawParts(partTransform, parts);
+    flushRenderQueue();
     oSpriteBatch->begin(partTransform);
-    drawParts(Matrix::Identity, parts);
     drawOnTops();
     oSpriteBatch->end();
     //if (holdingPart != -1)
@@ -375,6 +399,7 @@ void drawEditor()
     oSpriteBatch->begin(Matrix::CreateTranslation(0, -scrollPos, 0));
     oSpriteBatch->changeBlendMode(OBlendAlpha);
     float y = 20;
+    static CachedTexts catalogTexts;
     for (auto i = 0; i < (int)partDefs.size(); ++i)
     {
         auto& partDef = partDefs[i];
@@ -382,7 +407,7 @@ void drawEditor()
         {
             continue;
         }
-        g_pFont->draw(partDef.name + "\nPrice: " + std::to_string(partDef.price) + " $",
+        g_pFont->draw(formatText(getCachedText(catalogTexts, i), "%s\nPrice: %i $", partDef.name.c_str(), partDef.price),
                       Vector2(SCROLL_VIEW_W / 2, y), OTop);
         y += 32.0f;
         Vector2 pos(SCROLL_VIEW_W / 2, y + partDef.hsize.y * 64.f);
@@ -412,16 +437,29 @@ void drawEditor()
     oSpriteBatch->begin();
     Vector2 stageTextPos(OScreenWf - 20.0f, 20.0f);
     int stageId = (int)stages.size();
+    auto& stageStats = getStageStats();
+    static CachedText totalDeltaVText, hoverText, lastFlightText;
+    static CachedTexts stageTexts, stageStatsTexts;
+    g_pFont->draw(formatText(totalDeltaVText, "TOTAL DV: %i m/s", (int)getTotalDeltaV()), stageTextPos, OTopRight, Color(1, 1, 0));
+    stageTextPos.y += 24;
     for (auto& stage : stages)
     {
-        g_pFont->draw("--- Stage " + std::to_string(stageId) + " ---", stageTextPos, OTopRight, Color(1, 1, 1));
+        g_pFont->draw(formatText(getCachedText(stageTexts, stageId), "--- Stage %i ---", stageId), stageTextPos, OTopRight, Color(1, 1, 1));
         stageTextPos.y += 16;
+        auto& stats = stageStats[stages.size() - stageId];
+        if (stats.thrust > 0)
+        {
+            g_pFont->draw(formatText(getCachedText(stageStatsTexts, stageId), "DV %i TWR %i.%i %is",
+                                     (int)stats.deltaV, (int)stats.twr, (int)(stats.twr * 10) % 10, (int)stats.burnTime),
+                          stageTextPos, OTopRight, Color(1, 1, 0));
+            stageTextPos.y += 16;
+        }
         for (auto pPart : stage)
         {
             auto& partDef = partDefs[pPart->type];
             if (pPart == pHoverPart)
             {
-                g_pFont->draw("--> " + partDef.name, stageTextPos, OTopRight, Color(1, 0, 1));
+                g_pFont->draw(formatText(hoverText, "--> %s", partDef.name.c_str()), stageTextPos, OTopRight, Color(1, 0, 1));
             }
             else
             {
@@ -434,12 +472,25 @@ void drawEditor()
     }
     oSpriteBatch->end();
 
+    // Outcome of the last flight of this exact design
+    if (isDesignKnown)
+    {
+        g_pFont->draw(formatText(lastFlightText, "LAST FLIGHT: %s  DV: %i m/s  FUEL LEFT: %i%%",
+                                 knownResult.reachedOrbit ? "^090ORBIT^999" : "^900NO ORBIT^999",
+                                 (int)knownResult.deltaV, (int)(knownResult.fuelMargin * 100.0f)),
+                      {(OScreenWf + SCROLL_VIEW_W) / 2, 8}, OTop);
+    }
+
     // Help tooltips
-    g_pFont->draw("PRESS ^990ESC^999 TO CLEAR", {OScreenWf / 2, OScreenHf - 24}, OBottom);
-    g_pFont->draw("PRESS ^990SPACE BAR^999 TO LAUNCH", {OScreenWf / 2, OScreenHf - 8}, OBottom);
+    static const std::string clearHelp = "PRESS ^990ESC^999 TO CLEAR";
+    static const std::string launchHelp = "PRESS ^990SPACE BAR^999 TO LAUNCH";
+    static const std::string removeHelp = "PRESS ^909DELETE^999 REMOVE PART";
+    static const std::string moveHelp = "PRESS ^909UP/DOWN^999 TO MOVE STAGE";
+    g_pFont->draw(clearHelp, {OScreenWf / 2, OScreenHf - 24}, OBottom);
+    g_pFont->draw(launchHelp, {OScreenWf / 2, OScreenHf - 8}, OBottom);
     if (pHoverPart)
     {
-        if (pHoverPart != pMainPart) g_pFont->draw("PRESS ^909DELETE^999 REMOVE PART", {OScreenWf / 2, OScreenHf - 24 - 32}, OBottom);
-        g_pFont->draw("PRESS ^909UP/DOWN^999 TO MOVE STAGE", {OScreenWf / 2, OScreenHf - 8 - 32}, OBottom);
+        if (pHoverPart != pMainPart) g_pFont->draw(removeHelp, {OScreenWf / 2, OScreenHf - 24 - 32}, OBottom);
+        g_pFont->draw(moveHelp, {OScreenWf / 2, OScreenHf - 8 - 32}, OBottom);
     }
 }
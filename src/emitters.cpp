@@ -0,0 +1,236 @@
+#include <onut/CSV.h>
+#include <onut/Renderer.h>
+#include <onut/Texture.h>
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+#include <vector>
+
+#include "defines.h"
+#include "emitters.h"
+#include "part.h"
+#include "rng.h"
+
+struct Emitter
+{
+    Part* pPart;
+    int def;
+    float accumulator;
+};
+
+static std::vector<EmitterDef> emitterDefs;
+static std::vector<int> emitterDefsByPart[256]; // Indexed by part id
+
+// Kept grouped by part so each part's transform is only computed once
+static std::vector<Emitter> emitters;
+
+static int droppedParticles = 0;
+static int droppedLastSecond = 0;
+static float droppedTimer = 0;
+
+// Share of PARTICLE_BUDGET each priority may fill. Low priority effects stop
+// first and leave the room to exhaust and explosions.
+static const float PRIORITY_BUDGET_SHARES[] = {.6f, .85f, 1.0f};
+
+static std::unordered_map<std::string, int> EMITTER_PRIORITY_MAP = {
+    {"LOW", EMITTER_PRIORITY_LOW},
+    {"NORMAL", EMITTER_PRIORITY_NORMAL},
+    {"HIGH", EMITTER_PRIORITY_HIGH},
+};
+
+static std::unordered_map<std::string, int> PARTICLE_COLLISION_MAP = {
+    {"NONE", PARTICLE_COLLISION_NONE},
+    {"BOUNCE", PARTICLE_COLLISION_BOUNCE},
+    {"SETTLE", PARTICLE_COLLISION_SETTLE},
+};
+
+static std::unordered_map<std::string, int> EMITTER_WHEN_MAP = {
+    {"BURNING", EMITTER_WHEN_BURNING},
+    {"STAND_BY", EMITTER_WHEN_STAND_BY},
+    {"BURST", EMITTER_WHEN_BURST},
+};
+
+void initEmitters()
+{
+    auto pCSV = OGetCSV("ojam16 - emitters.csv");
+    auto rowCount = pCSV->getRowCount();
+    for (int i = 0; i < rowCount; ++i)
+    {
+        EmitterDef def;
+        def.name = pCSV->getValue("name", i);
+        def.when = EMITTER_WHEN_MAP[pCSV->getValue("when", i)];
+        def.partId = pCSV->getValue("partId", i).empty() ? -1 : pCSV->getInt("partId", i);
+        def.rate = pCSV->getFloat("rate", i);
+        def.burst = pCSV->getValue("burst", i).empty() ? 0 : pCSV->getInt("burst", i);
+        def.offset = Vector2(pCSV->getFloat("offsetX", i), pCSV->getFloat("offsetY", i));
+        def.inheritVel = pCSV->getValue("inheritVel", i) == "TRUE";
+        def.dir = Vector2(pCSV->getFloat("dirX", i), pCSV->getFloat("dirY", i));
+        def.spread = pCSV->getFloat("spread", i);
+        def.angleRandom = pCSV->getFloat("angleRandom", i);
+        def.angleVelRandom = pCSV->getFloat("angleVelRandom", i);
+        def.positionRandom = pCSV->getFloat("positionRandom", i);
+        def.velocityRandom = pCSV->getFloat("velocityRandom", i);
+        auto& priority = pCSV->getValue("priority", i);
+        if (!priority.empty()) def.priority = EMITTER_PRIORITY_MAP[priority];
+        def.budget = pCSV->getValue("budget", i).empty() ? 0 : pCSV->getInt("budget", i);
+        auto& collision = pCSV->getValue("collision", i);
+        if (!collision.empty()) def.collision = PARTICLE_COLLISION_MAP[collision];
+        setParticleSourceCollision((int)emitterDefs.size(), def.collision);
+
+        auto& particle = def.templateParticle;
+        particle.vel = Vector2(pCSV->getFloat("velX", i), pCSV->getFloat("velY", i));
+        particle.life = 0;
+        particle.duration = pCSV->getFloat("duration", i);
+        particle.colorFrom = Color(pCSV->getFloat("r0", i), pCSV->getFloat("g0", i), pCSV->getFloat("b0", i), pCSV->getFloat("a0", i));
+        particle.colorTo = Color(pCSV->getFloat("r1", i), pCSV->getFloat("g1", i), pCSV->getFloat("b1", i), pCSV->getFloat("a1", i));
+        particle.sizeFrom = pCSV->getFloat("sizeFrom", i);
+        particle.sizeTo = pCSV->getFloat("sizeTo", i);
+        particle.angle = pCSV->getFloat("angle", i);
+        particle.angleVel = pCSV->getFloat("angleVel", i);
+        particle.pTexture = OGetTexture(pCSV->getValue("texture", i));
+
+        if (def.when != EMITTER_WHEN_BURST && def.partId >= 0 && def.partId < 256)
+        {
+            emitterDefsByPart[def.partId].push_back((int)emitterDefs.size());
+        }
+        emitterDefs.push_back(def);
+    }
+}
+
+int getEmitterDef(const std::string& name)
+{
+    for (int i = 0; i < (int)emitterDefs.size(); ++i)
+    {
+        if (emitterDefs[i].name == name) return i;
+    }
+    return -1;
+}
+
+void attachEmitters(Part* pPart)
+{
+    auto id = partDefs[pPart->type].id;
+    if (id >= 0 && id < 256)
+    {
+        for (auto def : emitterDefsByPart[id]) emitters.push_back({pPart, def, 0.0f});
+    }
+    for (auto pChild : pPart->children) attachEmitters(pChild);
+}
+
+void detachEmitters(Part* pPart)
+{
+    for (auto it = emitters.begin(); it != emitters.end();)
+    {
+        if (it->pPart == pPart) it = emitters.erase(it);
+        else ++it;
+    }
+}
+
+// How many of count particles the def may spawn at position right now
+static int getParticleAllowance(int defIndex, int count, const Vector2& position)
+{
+    extern Vector2 cameraPos;
+    extern float zoom;
+    auto& def = emitterDefs[defIndex];
+
+    // More than a screen away from the camera, one priority lower
+    int priority = def.priority;
+    float farDistance = OScreenWf / zoom;
+    if (Vector2::DistanceSquared(position, cameraPos) > farDistance * farDistance)
+    {
+        priority = std::max(EMITTER_PRIORITY_LOW, priority - 1);
+    }
+
+    int allowed = std::min(count, (int)(PARTICLE_BUDGET * PRIORITY_BUDGET_SHARES[priority]) - particles.count);
+    if (def.budget > 0 && defIndex < MAX_PARTICLE_SOURCES)
+    {
+        allowed = std::min(allowed, def.budget - particles.sourceCounts[defIndex]);
+    }
+    allowed = std::max(0, allowed);
+    droppedParticles += count - allowed;
+    return allowed;
+}
+
+static void emit(int defIndex, int count, const Vector2& position, const Vector2& right, const Vector2& back, const Vector2& vel)
+{
+    auto& def = emitterDefs[defIndex];
+    auto templateParticle = def.templateParticle;
+    templateParticle.position = position + right * def.offset.x + back * def.offset.y;
+    count = getParticleAllowance(defIndex, count, templateParticle.position);
+    if (count <= 0) return;
+    int source = defIndex < MAX_PARTICLE_SOURCES ? defIndex : PARTICLE_NO_SOURCE;
+    templateParticle.vel = right * def.templateParticle.vel.x + back * def.templateParticle.vel.y;
+    if (def.inheritVel) templateParticle.vel += vel;
+    auto dir = right * def.dir.x + back * def.dir.y;
+
+    if (def.positionRandom == 0 && def.velocityRandom == 0)
+    {
+        spawnParticles(templateParticle, count, def.spread, def.angleRandom, 0, def.angleVelRandom, dir, source);
+        return;
+    }
+    auto basePosition = templateParticle.position;
+    auto baseVel = templateParticle.vel;
+    for (int i = 0; i < count; ++i)
+    {
+        templateParticle.position = basePosition + randVector2(RANDOM_STREAM_EFFECTS, Vector2(-def.positionRandom), Vector2(def.positionRandom));
+        templateParticle.vel = baseVel + randVector2(RANDOM_STREAM_EFFECTS, Vector2(-def.velocityRandom), Vector2(def.velocityRandom));
+        spawnParticles(templateParticle, 1, def.spread, def.angleRandom, 0, def.angleVelRandom, dir, source);
+    }
+}
+
+void updateEmitters(float dt)
+{
+    extern int gameState;
+    droppedTimer += dt;
+    if (droppedTimer >= 1.0f)
+    {
+        droppedTimer -= 1.0f;
+        droppedLastSecond = droppedParticles;
+        droppedParticles = 0;
+    }
+
+    Part* pLastPart = nullptr;
+    Vector2 position, right, back;
+    for (auto& emitter : emitters)
+    {
+        auto& def = emitterDefs[emitter.def];
+        auto pPart = emitter.pPart;
+        bool isOn = def.when == EMITTER_WHEN_STAND_BY ?
+            gameState == GAME_STATE_STAND_BY :
+            pPart->isBurning;
+        if (!isOn)
+        {
+            emitter.accumulator = 0;
+            continue;
+        }
+
+        // Fractional particles carry over so the rate holds at any tick rate
+        emitter.accumulator += def.rate * dt;
+        int count = (int)emitter.accumulator;
+        if (count <= 0) continue;
+        emitter.accumulator -= (float)count;
+
+        if (pPart != pLastPart)
+        {
+            auto transform = getWorldTransform(pPart);
+            position = Vector2(transform.Translation());
+            right = Vector2(transform.Right());
+            back = Vector2(transform.Up());
+            right.Normalize();
+            back.Normalize();
+            pLastPart = pPart;
+        }
+        emit(emitter.def, count, position, right, back, pPart->vel);
+    }
+}
+
+void burstEmitter(int emitterDef, const Vector2& position, const Vector2& right, const Vector2& back, const Vector2& vel)
+{
+    if (emitterDef < 0) return;
+    emit(emitterDef, emitterDefs[emitterDef].burst, position, right, back, vel);
+}
+
+int getDroppedParticleCount()
+{
+    return droppedLastSecond;
+}
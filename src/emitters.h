@@ -0,0 +1,55 @@
+#pragma once
+#include <onut/Maths.h>
+#include <string>
+
+#include "particle.h"
+
+struct Part;
+
+#define EMITTER_WHEN_BURNING 0
+#define EMITTER_WHEN_STAND_BY 1
+#define EMITTER_WHEN_BURST 2
+
+#define EMITTER_PRIORITY_LOW 0
+#define EMITTER_PRIORITY_NORMAL 1
+#define EMITTER_PRIORITY_HIGH 2
+
+// Live particles the governor aims for, see getParticleAllowance
+#define PARTICLE_BUDGET 20000
+
+// One row of "ojam16 - emitters.csv". Offsets, velocities and directions
+// are in the part's space: x to its right, y toward its back.
+struct EmitterDef
+{
+    std::string name;
+    int partId = -1;
+    int when = EMITTER_WHEN_BURNING;
+    Particle templateParticle;
+    float rate = 0;             // Particles per second
+    int burst = 0;
+    Vector2 offset;
+    bool inheritVel = false;
+    Vector2 dir;
+    float spread = 0;
+    float angleRandom = 0;
+    float angleVelRandom = 0;
+    float positionRandom = 0;
+    float velocityRandom = 0;
+    int priority = EMITTER_PRIORITY_NORMAL;
+    int budget = 0;             // Max live particles from this def, 0 for no limit
+    int collision = PARTICLE_COLLISION_NONE;
+};
+
+void initEmitters();
+int getEmitterDef(const std::string& name);
+
+// Continuous emitters, matched to parts by id
+void attachEmitters(Part* pPart);
+void detachEmitters(Part* pPart);
+void updateEmitters(float dt);
+
+// One-shot, right and back orient the def's offsets and directions
+void burstEmitter(int emitterDef, const Vector2& position, const Vector2& right, const Vector2& back, const Vector2& vel);
+
+// Particles refused by the governor over the last second
+int getDroppedParticleCount();
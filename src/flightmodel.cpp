@@ -0,0 +1,111 @@
+#include <algorithm>
+#include <cmath>
+
+#include "flightmodel.h"
+
+#define FLIGHT_MIN_STEP (1.0f / 30.0f)
+#define FLIGHT_MAX_STEP 2.0f
+#define FLIGHT_MAX_BURN_STEP .25f
+#define FLIGHT_ORBIT_ARC_PER_STEP .005f
+
+// Stages without fuel (decoupler only, or already spent) fire right away
+static void advanceStages(FlightState& state, const FlightStage* pStages, int stageCount)
+{
+    while (state.fuel <= 0.0f && state.stage < stageCount && state.time >= state.stageHold)
+    {
+        ++state.stage;
+        if (state.stage < stageCount)
+        {
+            state.mass = std::max(.001f, state.mass - pStages[state.stage].droppedMass);
+            state.fuel = pStages[state.stage].fuel;
+        }
+    }
+}
+
+void initFlightState(FlightState& state, const FlightStage* pStages, int stageCount)
+{
+    state.time = 0;
+    state.crashed = false;
+    state.stage = 0;
+    state.fuel = 0;
+    if (stageCount)
+    {
+        state.mass = std::max(.001f, state.mass - pStages[0].droppedMass);
+        state.fuel = pStages[0].fuel;
+    }
+    advanceStages(state, pStages, stageCount);
+}
+
+// Coast with big steps sized on the orbit curvature, burns with small ones
+// that land on burnout.
+float getFlightStepSize(const FlightState& state, const FlightStage* pStages, int stageCount)
+{
+    float radius = std::sqrtf(state.x * state.x + state.y * state.y);
+    float speed = std::max(1.0f, std::sqrtf(state.vx * state.vx + state.vy * state.vy));
+    float dt = FLIGHT_ORBIT_ARC_PER_STEP * radius / speed;
+    if (state.stage < stageCount && state.fuel > 0)
+    {
+        auto& stage = pStages[state.stage];
+        dt = std::min(dt, FLIGHT_MAX_BURN_STEP);
+        if (stage.burnRate > 0) dt = std::min(dt, state.fuel / stage.burnRate);
+    }
+    return std::max(FLIGHT_MIN_STEP, std::min(FLIGHT_MAX_STEP, dt));
+}
+
+void stepFlight(const FlightWorld& world, FlightState& state, const FlightStage* pStages, int stageCount, float dt)
+{
+    if (state.crashed) return;
+
+    float radius = std::sqrtf(state.x * state.x + state.y * state.y);
+    float upX = state.x / radius;
+    float upY = state.y / radius;
+    float ax = -upX * world.gravity;
+    float ay = -upY * world.gravity;
+
+    if (state.stage < stageCount)
+    {
+        auto& stage = pStages[state.stage];
+        if (stage.thrust > 0 && state.fuel > 0)
+        {
+            float burnt = std::min(state.fuel, stage.burnRate * dt);
+            float thrustDt = stage.burnRate > 0 ? burnt / stage.burnRate : dt;
+            float c = std::cosf(state.pitch);
+            float s = std::sinf(state.pitch);
+            float forwardX = upX * c - upY * s;
+            float forwardY = upX * s + upY * c;
+            float accel = stage.thrust / state.mass * (thrustDt / dt);
+            ax += forwardX * accel;
+            ay += forwardY * accel;
+            state.fuel -= burnt;
+            state.mass = std::max(.001f, state.mass - burnt);
+        }
+        else
+        {
+            state.fuel = 0;
+        }
+    }
+    advanceStages(state, pStages, stageCount);
+
+    // Same integration order as updatePart
+    state.vx += ax * dt;
+    state.vy += ay * dt;
+    state.x += state.vx * dt;
+    state.y += state.vy * dt;
+    state.time += dt;
+
+    if (state.x * state.x + state.y * state.y < world.planetRadius * world.planetRadius)
+    {
+        state.crashed = true;
+    }
+}
+
+float getPitch(float x, float y, float angle)
+{
+    float radius = std::sqrtf(x * x + y * y);
+    if (radius <= 0) return 0;
+    float upX = x / radius;
+    float upY = y / radius;
+    float forwardX = std::sinf(angle);
+    float forwardY = -std::cosf(angle);
+    return std::atan2f(upX * forwardY - upY * forwardX, upX * forwardX + upY * forwardY);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+// Point mass model of a vehicle and its remaining stages, used for look-ahead
+// simulation. It has no engine dependency and no global state so it can be
+// copied around freely and stepped on any thread.
+
+struct FlightWorld
+{
+    float gravity;
+    float planetRadius;
+};
+
+// One burn, in firing order
+struct FlightStage
+{
+    float thrust;
+    float burnRate;     // Fuel mass per second
+    float fuel;
+    float droppedMass;  // Leaves the vehicle when the stage fires
+};
+
+struct FlightState
+{
+    float x, y;
+    float vx, vy;
+    float pitch;        // Heading relative to local vertical, same sense as Part::angle
+    float mass;
+    float fuel;         // Left in the burning stage
+    float time;
+    float stageHold;    // Next stage doesn't fire before that time
+    int stage;          // Burning stage, stageCount once everything is spent
+    bool crashed;
+};
+
+// Call once mass and stageHold are set, fires the first stage
+void initFlightState(FlightState& state, const FlightStage* pStages, int stageCount);
+float getFlightStepSize(const FlightState& state, const FlightStage* pStages, int stageCount);
+void stepFlight(const FlightWorld& world, FlightState& state, const FlightStage* pStages, int stageCount, float dt);
+float getPitch(float x, float y, float angle);
@@ -0,0 +1,120 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "jobs.h"
+
+#define MAX_JOB_WORKERS 7
+
+struct JobBatch
+{
+    const std::function<void(int)>* pFn;
+    int count;
+    std::atomic<int> next;
+};
+
+static std::mutex jobMutex;
+static std::condition_variable jobWake;
+static std::condition_variable jobFinished;
+static JobBatch* pCurrentBatch = nullptr; // Guarded by jobMutex
+static int batchId = 0;
+static int busyWorkers = 0;
+static bool isQuitting = false;
+
+static void runBatch(JobBatch& batch)
+{
+    int i;
+    while ((i = batch.next.fetch_add(1)) < batch.count)
+    {
+        (*batch.pFn)(i);
+    }
+}
+
+static void jobThread()
+{
+    int lastBatchId = 0;
+    while (true)
+    {
+        JobBatch* pBatch;
+        {
+            std::unique_lock<std::mutex> lock(jobMutex);
+            jobWake.wait(lock, [&] { return isQuitting || batchId != lastBatchId; });
+            if (isQuitting) return;
+            lastBatchId = batchId;
+            pBatch = pCurrentBatch;
+            if (!pBatch) continue; // Woke up too late, already finished
+            ++busyWorkers;
+        }
+
+        runBatch(*pBatch);
+
+        {
+            std::lock_guard<std::mutex> lock(jobMutex);
+            --busyWorkers;
+        }
+        jobFinished.notify_one();
+    }
+}
+
+struct JobPool
+{
+    std::vector<std::thread> threads;
+
+    JobPool()
+    {
+        int count = std::min((int)std::thread::hardware_concurrency() - 1, MAX_JOB_WORKERS);
+        for (int i = 0; i < count; ++i) threads.push_back(std::thread(jobThread));
+    }
+
+    ~JobPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(jobMutex);
+            isQuitting = true;
+        }
+        jobWake.notify_all();
+        for (auto& thread : threads) thread.join();
+    }
+};
+
+static JobPool& getJobPool()
+{
+    static JobPool pool;
+    return pool;
+}
+
+int getJobThreadCount()
+{
+    return (int)getJobPool().threads.size() + 1;
+}
+
+void parallelFor(int count, const std::function<void(int)>& fn)
+{
+    if (count <= 0) return;
+    if (count == 1 || getJobPool().threads.empty())
+    {
+        for (int i = 0; i < count; ++i) fn(i);
+        return;
+    }
+
+    JobBatch batch;
+    batch.pFn = &fn;
+    batch.count = count;
+    batch.next = 0;
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        pCurrentBatch = &batch;
+        ++batchId;
+    }
+    jobWake.notify_all();
+
+    runBatch(batch);
+
+    // Nobody may still be holding the batch when it goes out of scope
+    std::unique_lock<std::mutex> lock(jobMutex);
+    pCurrentBatch = nullptr;
+    jobFinished.wait(lock, [] { return busyWorkers == 0; });
+}
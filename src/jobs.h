@@ -0,0 +1,8 @@
+#pragma once
+#include <functional>
+
+// Small fixed pool of worker threads. parallelFor runs fn(i) for every i in
+// [0, count) across the workers and the calling thread, and returns once
+// they are all done.
+void parallelFor(int count, const std::function<void(int)>& fn);
+int getJobThreadCount();
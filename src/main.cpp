@@ -17,14 +17,29 @@
 #include <onut/ContentManager.h>
 #include <onut/Sound.h>
 
+#include <chrono>
 #include <vector>
 #include <iomanip>
 #include <sstream>
 
+#include "autopilot.h"
+#include "coverage.h"
+#include "culling.h"
+#include "emitters.h"
+#include "design.h"
 #include "meshes.h"
 #include "part.h"
 #include "editor.h"
 #include "particle.h"
+#include "physics.h"
+#include "predictor.h"
+#include "renderqueue.h"
+#include "rng.h"
+#include "satellites.h"
+#include "snapshot.h"
+#include "terrain.h"
+#include "textcache.h"
+#include "vehiclemesh.h"
 
 void init();
 void update();
@@ -33,7 +48,10 @@ void postRender();
 
 OFontRef g_pFont;
 OTextureRef pWhiteTexture;
-OTextureRef pMiniMap;
+OTextureRef pMiniMap;       // Satellites and trajectory, refreshed at miniMapRefreshRate
+OTextureRef pMiniMapBase;   // Planet, drawn once
+OTextureRef pMiniMapOrbit;  // Drawn when plotPoints change
+float miniMapRefreshRate = 10.0f; // Per second, 0 for every frame
 
 float zoom = 64;
 int gameState = GAME_STATE_EDITOR;
@@ -94,11 +112,21 @@ void init()
     uint32_t white = 0xFFFFFFFF;
     pWhiteTexture = OTexture::createFromData((uint8_t*)&white, {1, 1}, false);
     pMiniMap = OTexture::createRenderTarget({MINIMAP_SIZE, MINIMAP_SIZE}, false);
+    pMiniMapBase = OTexture::createRenderTarget({MINIMAP_SIZE, MINIMAP_SIZE}, false);
+    pMiniMapOrbit = OTexture::createRenderTarget({MINIMAP_SIZE, MINIMAP_SIZE}, false);
+    auto seed = (uint64_t)GetTickCount64();
+    seedRandomStream(RANDOM_STREAM_PHYSICS, seed);
+    seedRandomStream(RANDOM_STREAM_EFFECTS, seed + 1);
+    seedRandomStream(RANDOM_STREAM_AUDIO, seed + 2);
+    initTerrain();
     createMeshes();
     orbitIndicatorAnim.play(.5f, 1.0f, .35f, OTweenEaseBoth, OPingPongLoop);
     
     initPartDefs();
+    initEmitters();
+    loadFlightResults();
     resetEditor();
+    loadSatelliteCatalog();
 
     playMusic("OJAM2016_Music_Build.mp3");
 }
@@ -120,7 +148,7 @@ void updateCamera()
     shakeAmount = std::min(1.0f, shakeAmount);
     if (!cameraShaking.isPlaying())
     {
-        Vector2 dir = ORandVector2(-Vector2::One, Vector2::One);
+        Vector2 dir = randVector2(RANDOM_STREAM_EFFECTS, -Vector2::One, Vector2::One);
         cameraShaking.playFromCurrent(dir * shakeAmount * .05f, .05f, OTweenEaseOut);
     }
 }
@@ -131,6 +159,7 @@ void decouple(Part* pPart)
     int side = 0;
     //if (pPart->type == PART_DECOUPLER_HORIZONTAL_LEFT) side = -1;
     //if (pPart->type == PART_DECOUPLER_HORIZONTAL_RIGHT) side = 1;
+    invalidateVehicleMesh(pPart);
     auto mtransform = getWorldTransform(pPart);
     auto forward = mtransform.Up();
     auto right = mtransform.Right();
@@ -142,9 +171,9 @@ void decouple(Part* pPart)
         right.Normalize();
         forward *= -1;
         forward.Normalize();
-        auto currentDir = pChild->vel;
-        currentDir.Normalize();
-        pChild->angleVelocity += ORandFloat(-1, 1);
+        Vector2 currentDir;
+        getDecoupleKick(pChild->vel.x, pChild->vel.y, currentDir.x, currentDir.y);
+        pChild->angleVelocity += randFloat(RANDOM_STREAM_PHYSICS, -1, 1);
         if (side == 0)
         {
             pChild->vel -= currentDir;
@@ -166,8 +195,8 @@ void decouple(Part* pPart)
     }
     if (pPart->pParent)
     {
-        auto currentDir = pPart->pParent->vel;
-        currentDir.Normalize();
+        Vector2 currentDir;
+        getDecoupleKick(pPart->pParent->vel.x, pPart->pParent->vel.y, currentDir.x, currentDir.y);
         auto pTopParent = getTopParent(pPart->pParent);
         if (side == 0)
         {
@@ -195,33 +224,17 @@ void decouple(Part* pPart)
     pPart->angle = std::atan2f(forward.x, -forward.y);
     pPart->position = mtransform.Translation();
     pPart->pParent = nullptr;
-    pPart->angleVelocity += ORandFloat(-1, 1);
+    pPart->angleVelocity += randFloat(RANDOM_STREAM_PHYSICS, -1, 1);
     pPart->children.clear();
     parts.push_back(pPart);
 
-    extern OTextureRef pSmokeTexture;
-    spawnParticles({
-        pPart->position,
-        pPart->vel - Vector2(right) * ORandFloat(.15f, .25f),
-        0,
-        1,
-        Color(1, 1, 1, 1), Color(0, 0, 0, 0),
-        .5f, 0.65f,
-        2.0f,
-        45.0f,
-        pSmokeTexture
-    }, 3, 30, 360.0f, 0, 0, -right);
-    spawnParticles({
-        pPart->position,
-        pPart->vel + Vector2(right) * ORandFloat(.15f, .25f),
-        0,
-        1,
-        Color(1, 1, 1, 1), Color(0, 0, 0, 0),
-        .5f, 0.65f,
-        2.0f,
-        45.0f,
-        pSmokeTexture
-    }, 3, 30, 360.0f, 0, 0, right);
+    // Same axes as updateEmitters, y toward the part's back
+    auto back = mtransform.Up();
+    back.Normalize();
+    static int decoupleSmokeLeft = getEmitterDef("decoupleSmokeLeft");
+    static int decoupleSmokeRight = getEmitterDef("decoupleSmokeRight");
+    burstEmitter(decoupleSmokeLeft, pPart->position, Vector2(right), Vector2(back), pPart->vel);
+    burstEmitter(decoupleSmokeRight, pPart->position, Vector2(right), Vector2(back), pPart->vel);
 }
 //Vector2 position;
 //Vector2 vel;
@@ -239,6 +252,7 @@ void activateNextStage()
     auto cameraBefore = vehiculeRect(pMainPart).Center() - pMainPart->position;
     if (stages.size() > 1)
     {
+        pushFlightSnapshot();
         auto currentState = stages.back();
         stages.erase(stages.end() - 1);
         auto& newStage = stages.back();
@@ -263,7 +277,8 @@ void activateNextStage()
             {
                 if (hasStableOrbit)
                 {
-                    switch (ORandInt(0, 3))
+                    auto satelliteTexture = randInt(RANDOM_STREAM_EFFECTS, 0, 3);
+                    switch (satelliteTexture)
                     {
                         case 0:
                             partDefs[PART_TYPE_SATELLITE].pTexture = OGetTexture("SATELLITE_1.png");
@@ -280,6 +295,8 @@ void activateNextStage()
                     }
                     partDefs[PART_TYPE_SATELLITE].hsize = partDefs[PART_TYPE_SATELLITE].pTexture->getSizef() / 128.0f;
                     pPart->type = PART_TYPE_SATELLITE;
+                    invalidateVehicleMesh(pPart);
+                    catalogSatellite(Vector2(getWorldTransform(pPart).Translation()), getTopParent(pPart)->vel, satelliteTexture);
                     playMusic("SatelliteLoop.mp3");
                 }
                 else
@@ -297,6 +314,7 @@ void activateNextStage()
         auto cameraOffsetf = cameraBefore - cameraAfter;
         cameraOffsetf = Vector2::Transform(cameraOffsetf, Matrix::CreateRotationZ(pMainPart->angle));
         cameraOffset.play(cameraOffsetf, Vector2::Zero, 1, OTweenEaseOut);
+        requestPredictionNow();
     }
     else
     {
@@ -327,20 +345,12 @@ void updateVoices()
     {
         voiceTrigger = 0;
         std::stringstream ss;
-        ss << "SpySatellite_Voice_Secrets_" << std::setw(2) << std::setfill('0') << ORandInt(1, 66) << ".mp3";
+        ss << "SpySatellite_Voice_Secrets_" << std::setw(2) << std::setfill('0') << randInt(RANDOM_STREAM_AUDIO, 1, 66) << ".mp3";
         pCurrentVoice = OMusic::createFromFile(oContentManager->findResourceFile(ss.str()), nullptr);
         pCurrentVoice->play();
     }
 }
 
-float getSpaceDistance()
-{
-    float d1 = ((float)ATMOSPHERES_COUNT);
-    d1 *= d1;
-    d1 = PLANET_SIZE + PLANET_SIZE * ATMOSPHERES_SCALE * d1;
-    return d1;
-}
-
 void updateOrbit()
 {
     plotPoints.clear();
@@ -348,60 +358,40 @@ void updateOrbit()
     // Draw the orbit
     if (pMainPart)
     {
-        // Prepare our data
-        auto vel = pMainPart->vel;
-        auto velSpeed = vel.Length();
-        auto velDir = vel;
-        auto position = pMainPart->position;
-        auto dirToCenter = position;
-        dirToCenter.Normalize();
-        velDir.Normalize();
-
-        float currentDot = velDir.Dot(dirToCenter);
-        if (currentDot < 1 && currentDot > -1)
+        auto apsides = findApsides(pMainPart->position.x, pMainPart->position.y, pMainPart->vel.x, pMainPart->vel.y);
+        for (int i = 0; i < apsides.count; ++i)
         {
-            float time = 0.0f;
-            float step = .1f;
-            float testDot = currentDot;
-            Vector2 highestPoint = position;
-            while (plotPoints.size() < 2 && time < 300.0f)
-            {
-                while (((currentDot >= 0 && testDot >= 0) ||
-                    (currentDot <= 0 && testDot <= 0)) && time < 300.0f)
-                {
-                    highestPoint += vel;
-                    velDir = vel;
-                    velDir.Normalize();
-                    Vector2 Vg = highestPoint;
-                    Vg.Normalize();
-                    testDot = velDir.Dot(Vg);
-                    vel -= Vg * GRAVITY;
-                    time += step;
-                }
-                plotPoints.push_back(highestPoint);
-                currentDot = testDot;
-            }
-            // Get next one!
-            if (time < 300.0f)
-            {
-                if (plotPoints[0].Length() >= getSpaceDistance() &&
-                    plotPoints[1].Length() >= getSpaceDistance())
-                {
-                    hasStableOrbit = true;
-                }
-                plotPoints.push_back(-plotPoints[0]);
-                plotPoints.push_back(-plotPoints[1]);
-            }
+            plotPoints.push_back(Vector2(apsides.x[i], apsides.y[i]));
+        }
+        if (apsides.isClosed)
+        {
+            hasStableOrbit = isStableOrbit(apsides);
+            plotPoints.push_back(-plotPoints[0]);
+            plotPoints.push_back(-plotPoints[1]);
         }
     }
 }
 
-extern int spawn;
+void quickLoad()
+{
+    if (!popFlightSnapshot()) return;
+    extern Part* pHoverPart;
+    pHoverPart = nullptr;
+    cancelFlightRecord();
+    clearPrediction();
+    resetAutopilot();
+    playMusic("OJAM2016_Music_Launch.mp3");
+}
 
 void update()
 {
-    spawn++;
     updateMusic();
+    if (OInputJustPressed(OKeyF9))
+    {
+        quickLoad();
+    }
+    updateSatellites(ODT);
+    updateCoverage();
     switch (gameState)
     {
         case GAME_STATE_EDITOR:
@@ -414,6 +404,9 @@ void update()
             {
                 gameState = GAME_STATE_STAND_BY;
                 voiceTrigger = 200;
+                beginFlightRecord(pMainPart);
+                seedRandomStream(RANDOM_STREAM_PHYSICS, getDesignHash(pMainPart));
+                for (auto pPart : parts) attachEmitters(pPart);
                 auto vrect = vehiculeRect(pMainPart);
                 scafoldingPos = vrect.z / 2;
                 pMainPart->position = {0, -PLANET_SIZE - vrect.w};
@@ -430,6 +423,9 @@ void update()
                 plotPoints.clear();
                 hasStableOrbit = false;
                 shakeAmount = 0;
+                clearFlightSnapshots();
+                clearPrediction();
+                resetAutopilot();
             }
             else
             {
@@ -450,6 +446,8 @@ void update()
             updateVoices();
             if (OInputJustPressed(OKeyEscape))
             {
+                cancelFlightRecord();
+                resetAutopilot();
                 resetEditor();
                 gameState = GAME_STATE_EDITOR;
                 playMusic("OJAM2016_Music_Build.mp3");
@@ -462,7 +460,12 @@ void update()
             {
                 activateNextStage();
             }
+            if (OInputJustPressed(OKeyA))
+            {
+                toggleAutopilot();
+            }
             controlTheFuckingRocket();
+            updateAutopilot();
             for (auto pPart : parts) updatePart(pPart);
             for (auto pToKill : toKill)
             {
@@ -472,6 +475,8 @@ void update()
             updateCamera();
             updateVoices();
             updateOrbit();
+            requestPrediction();
+            updatePrediction();
             if (pMainPart)
             {
                 auto& partDef = partDefs[pMainPart->type];
@@ -483,6 +488,10 @@ void update()
             }
             if (endTimer <= 0.f || OInputJustPressed(OKeyEscape))
             {
+                if (endTimer <= 0.f) endFlightRecord();
+                else cancelFlightRecord();
+                saveSatelliteCatalog();
+                resetAutopilot();
                 resetEditor();
                 gameState = GAME_STATE_EDITOR;
                 playMusic("OJAM2016_Music_Build.mp3");
@@ -490,6 +499,7 @@ void update()
             break;
         }
     }
+    updateEmitters(ODT);
     updateParticles();
 }
 
@@ -499,72 +509,58 @@ void drawWorld()
     oRenderer->renderStates.primitiveMode = OPrimitivePointList;
     drawMesh(Matrix::CreateScale(OScreenWf / 800.0f), starMesh);
     oRenderer->renderStates.primitiveMode = OPrimitiveTriangleList;
-    oRenderer->set2DCameraOffCenter(cameraPos, zoom);
-    drawMeshIndexed(Matrix::Identity, atmosphereMesh);
-    drawMeshIndexed(Matrix::Identity, planetMesh);
-
-    oSpriteBatch->begin();
-    oRenderer->set2DCameraOffCenter(cameraPos, zoom);
-    oSpriteBatch->drawRect(OGetTexture("BGstuff.png"),
-                           Rect(
-                           -346.0f / 64.0f,
-                           -PLANET_SIZE - 168.0f / 64.0f,
-                           791.0f / 64.0f,
-                           588.0f / 64.0f));
-    oSpriteBatch->drawRect(OGetTexture("BGscaffold.png"),
-                           Rect(
-                           -51.0f / 64.0f + .5f,// + scafoldingPos,
-                           -PLANET_SIZE - 660.0f / 64.0f,
-                           339.0f / 64.0f,
-                           681.0f / 64.0f));
-    oSpriteBatch->end();
+    updatePlanetArcs(getCameraRect(), zoom);
+    queueMeshIndexed(RENDER_LAYER_PLANET, Matrix::Identity, atmosphereArcMesh);
+    queueMeshIndexed(RENDER_LAYER_PLANET, Matrix::Identity, planetArcMesh);
+    static auto pBGStuff = OGetTexture("BGstuff.png");
+    static auto pBGScaffold = OGetTexture("BGscaffold.png");
+    queueDraw(RENDER_LAYER_BACKGROUND, OBlendPreMultiplied, pBGStuff, backgroundMesh.pVB, backgroundMesh.pIB, Matrix::Identity, 0, 6);
+    queueDraw(RENDER_LAYER_BACKGROUND, OBlendPreMultiplied, pBGScaffold, backgroundMesh.pVB, backgroundMesh.pIB, Matrix::Identity, 6, 6);
 }
 
 void drawParts()
 {
-    oSpriteBatch->begin();
-    oRenderer->set2DCameraOffCenter(cameraPos, zoom);
-    drawParts(Matrix::Identity, parts);
-    drawOnTops();
+    auto cameraRect = getCameraRect();
+    drawParts(Matrix::Identity, parts, &cameraRect);
     //extern Vector2 centerOfMass;
     //oSpriteBatch->drawCross(centerOfMass + parts[0]->position, .05f, Color(0, .5f, 1, 1));
     //oSpriteBatch->drawOutterOutlineRect(vehiculeRect(parts[0]), .1f, Color(1, 1, 0));
-    oSpriteBatch->end();
 }
 
-void drawMiniMap()
+static void beginMiniMapLayer(const OTextureRef& pLayer, const Color& clearColor)
 {
-    //--- Update minimap content
-    oRenderer->renderStates.renderTarget.push(pMiniMap);
+    oRenderer->renderStates.renderTarget.push(pLayer);
     oRenderer->renderStates.viewport.push({0, 0, MINIMAP_SIZE, MINIMAP_SIZE});
-    oRenderer->clear(Color::Black);
+    oRenderer->clear(clearColor);
     oRenderer->renderStates.primitiveMode = OPrimitiveTriangleList;
-    float zoomf = ((float)MINIMAP_SIZE / (float)PLANET_SIZE) / 8;
+}
+
+static void endMiniMapLayer()
+{
+    oRenderer->renderStates.renderTarget.pop();
+    oRenderer->renderStates.viewport.pop();
+}
+
+// Planet and atmosphere never change
+static void drawMiniMapBase(float zoomf)
+{
+    beginMiniMapLayer(pMiniMapBase, Color::Black);
     oRenderer->set2DCameraOffCenter(Vector2::Zero, zoomf);
     drawMeshIndexed(Matrix::Identity, atmosphereMesh);
     drawMeshIndexed(Matrix::Identity, planetMesh);
+    endMiniMapLayer();
+}
 
-    // Draw the orbit
-    if (pMainPart)
-    {
-        // Prepare our data
-        auto position = pMainPart->position;
-        oPrimitiveBatch->begin(OPrimitiveLineStrip);
-        oRenderer->set2DCameraOffCenter(Vector2::Zero, zoomf);
-        oPrimitiveBatch->draw(position + Vector2(-1000, 0), Color(1, 0, 1));
-        oPrimitiveBatch->draw(position + Vector2(0, 1000), Color(1, 0, 1));
-        oPrimitiveBatch->draw(position + Vector2(1000, 0), Color(1, 0, 1));
-        oPrimitiveBatch->draw(position + Vector2(0, -1000), Color(1, 0, 1));
-        oPrimitiveBatch->draw(position + Vector2(-1000, 0), Color(1, 0, 1));
-        oPrimitiveBatch->end();
-    }
-
+// Only when plotPoints changed. Drawn plain, the stable orbit pulse is a tint
+// when compositing.
+static void drawMiniMapOrbit(float zoomf)
+{
+    beginMiniMapLayer(pMiniMapOrbit, Color(0, 0, 0, 0));
     if (plotPoints.size() == 4)
     {
         oPrimitiveBatch->begin(OPrimitiveLineStrip);
         oRenderer->set2DCameraOffCenter(Vector2::Zero, zoomf);
         Color orbitColor = Color(.75f, .75f, .75f, 1);
-        if (hasStableOrbit) orbitColor *= orbitIndicatorAnim.get();
         for (int i = 0; i < 4; ++i)
         {
             Vector2 p0 = plotPoints[i];
@@ -616,64 +612,195 @@ void drawMiniMap()
             oPrimitiveBatch->end();
         }*/
     }
+    endMiniMapLayer();
+}
 
-    oRenderer->renderStates.renderTarget.pop();
-    oRenderer->renderStates.viewport.pop();
+// Satellites and the powered trajectory, at miniMapRefreshRate
+static void drawMiniMapDynamic(float zoomf)
+{
+    beginMiniMapLayer(pMiniMap, Color(0, 0, 0, 0));
+
+    // Satellites from previous flights
+    drawSatellites(zoomf);
+
+    // Powered trajectory from the predictor
+    auto& predictedPath = getPredictedPath();
+    if (pMainPart && predictedPath.size() > 1)
+    {
+        oPrimitiveBatch->begin(OPrimitiveLineStrip);
+        oRenderer->set2DCameraOffCenter(Vector2::Zero, zoomf);
+        for (auto& pt : predictedPath)
+        {
+            oPrimitiveBatch->draw(pt, Color(1, .5f, 0, 1));
+        }
+        oPrimitiveBatch->end();
+    }
+    endMiniMapLayer();
+}
+
+void drawMiniMap()
+{
+    float zoomf = ((float)MINIMAP_SIZE / (float)PLANET_SIZE) / 8;
+
+    //--- Update the layers that need it
+    static bool isBaseDrawn = false;
+    if (!isBaseDrawn)
+    {
+        drawMiniMapBase(zoomf);
+        isBaseDrawn = true;
+    }
+
+    static std::vector<Vector2> drawnPlotPoints;
+    static bool isOrbitDrawn = false;
+    if (!isOrbitDrawn || drawnPlotPoints != plotPoints)
+    {
+        drawMiniMapOrbit(zoomf);
+        drawnPlotPoints = plotPoints;
+        isOrbitDrawn = true;
+    }
+
+    static auto lastDynamicTime = std::chrono::steady_clock::time_point();
+    auto now = std::chrono::steady_clock::now();
+    if (miniMapRefreshRate <= 0 ||
+        std::chrono::duration<float>(now - lastDynamicTime).count() >= 1.0f / miniMapRefreshRate)
+    {
+        drawMiniMapDynamic(zoomf);
+        lastDynamicTime = now;
+    }
 
     //--- Draw it in the top right corner
+    Rect miniMapRect(OScreenWf - MINIMAP_SIZE, 0, MINIMAP_SIZE, MINIMAP_SIZE);
+    Color orbitColor = Color::White;
+    if (hasStableOrbit) orbitColor *= orbitIndicatorAnim.get();
     oSpriteBatch->begin();
-    oSpriteBatch->drawRect(pMiniMap, {OScreenWf - MINIMAP_SIZE, 0, MINIMAP_SIZE, MINIMAP_SIZE});
-    oSpriteBatch->drawRect(nullptr, {OScreenWf - MINIMAP_SIZE, OScreenHf - MINIMAP_SIZE, MINIMAP_SIZE, MINIMAP_SIZE}, Color(0, 0, 0, .5f));
+    oSpriteBatch->drawRect(pMiniMapBase, miniMapRect);
+    oSpriteBatch->drawRect(pMiniMapOrbit, miniMapRect, orbitColor);
+    oSpriteBatch->drawRect(pMiniMap, miniMapRect);
     oSpriteBatch->end();
+
+    // Vehicle marker moves every frame, straight on screen
+    if (pMainPart)
+    {
+        float size = 1000 * zoomf;
+
+        // Pinned to the minimap's edge when the vehicle is further out than it shows
+        auto position = miniMapRect.Center() + pMainPart->position * zoomf;
+        position.x = std::max(miniMapRect.x + size, std::min(miniMapRect.x + miniMapRect.z - size, position.x));
+        position.y = std::max(miniMapRect.y + size, std::min(miniMapRect.y + miniMapRect.w - size, position.y));
+        oPrimitiveBatch->begin(OPrimitiveLineStrip);
+        oPrimitiveBatch->draw(position + Vector2(-size, 0), Color(1, 0, 1));
+        oPrimitiveBatch->draw(position + Vector2(0, size), Color(1, 0, 1));
+        oPrimitiveBatch->draw(position + Vector2(size, 0), Color(1, 0, 1));
+        oPrimitiveBatch->draw(position + Vector2(0, -size), Color(1, 0, 1));
+        oPrimitiveBatch->draw(position + Vector2(-size, 0), Color(1, 0, 1));
+        oPrimitiveBatch->end();
+    }
+}
+
+// HUD geometry, built in local space and only rebuilt when the window size
+// changes. The radar is drawn rotated by the ship's angle around the planet.
+struct HUDCache
+{
+    Vector2 resolution;
+    Vector2 radarPos;
+    Mesh radarBackdrop;     // Screen space, triangle list
+    Mesh radarLines;        // Ring and ticks, line list
+    Mesh radarPlanet;       // Half disc, triangle list
+    Mesh radarArrow;        // Heading, line list, pointing up
+};
+
+static HUDCache hudCache;
+
+#define RADAR_SIZE 60.0f
+
+static void createHUDMesh(Mesh& mesh, const std::vector<Mesh::Vertex>& vertices)
+{
+    mesh.pVB = OVertexBuffer::createStatic(vertices.data(), (uint32_t)(vertices.size() * sizeof(Mesh::Vertex)));
+    mesh.indexCount = (uint32_t)vertices.size();
+}
+
+static void updateHUDCache()
+{
+    Vector2 resolution(OScreenWf, OScreenHf);
+    if (hudCache.radarLines.pVB && hudCache.resolution == resolution) return;
+    hudCache.resolution = resolution;
+    hudCache.radarPos = Vector2(OScreenWf - MINIMAP_SIZE / 2, OScreenHf - MINIMAP_SIZE / 2);
+
+    // Colors are premultiplied, drawn with OBlendPreMultiplied
+    std::vector<Mesh::Vertex> vertices;
+    Color backdropColor(0, 0, 0, .5f);
+    float left = OScreenWf - MINIMAP_SIZE, top = OScreenHf - MINIMAP_SIZE;
+    float right = OScreenWf, bottom = OScreenHf;
+    vertices = {
+        {{left, top}, {0, 0}, backdropColor}, {{left, bottom}, {0, 1}, backdropColor}, {{right, bottom}, {1, 1}, backdropColor},
+        {{left, top}, {0, 0}, backdropColor}, {{right, bottom}, {1, 1}, backdropColor}, {{right, top}, {1, 0}, backdropColor},
+    };
+    createHUDMesh(hudCache.radarBackdrop, vertices);
+
+    // Ring, as segments, then a tick every 15 degrees, shorter every 45
+    vertices.clear();
+    for (int i = 0; i < 360; i += 15)
+    {
+        float angle1 = DirectX::XMConvertToRadians((float)i);
+        float angle2 = DirectX::XMConvertToRadians((float)i + 15);
+        vertices.push_back({Vector2(std::cosf(angle1), std::sinf(angle1)) * RADAR_SIZE, Vector2::Zero, Color::White});
+        vertices.push_back({Vector2(std::cosf(angle2), std::sinf(angle2)) * RADAR_SIZE, Vector2::Zero, Color::White});
+    }
+    for (int i = 0; i < 360; i += 15)
+    {
+        float angle = DirectX::XMConvertToRadians((float)i);
+        float dist = 3;
+        if (i % 45) dist = 6;
+        vertices.push_back({Vector2(std::cosf(angle), std::sinf(angle)) * RADAR_SIZE, Vector2::Zero, Color::White});
+        vertices.push_back({Vector2(std::cosf(angle), std::sinf(angle)) * (RADAR_SIZE + dist), Vector2::Zero, Color::White});
+    }
+    createHUDMesh(hudCache.radarLines, vertices);
+
+    vertices.clear();
+    Color planetColor(0, .5f, 0, .75f);
+    planetColor = planetColor.AdjustedSaturation(.5f);
+    planetColor = Color(planetColor.x * planetColor.w, planetColor.y * planetColor.w, planetColor.z * planetColor.w, planetColor.w);
+    for (int i = 0; i < 180; i += 15)
+    {
+        float angle1 = DirectX::XMConvertToRadians((float)i);
+        float angle2 = DirectX::XMConvertToRadians((float)i + 15);
+        vertices.push_back({Vector2(std::cosf(angle1), std::sinf(angle1)) * (RADAR_SIZE - 2), Vector2::Zero, planetColor});
+        vertices.push_back({Vector2(std::cosf(angle2), std::sinf(angle2)) * (RADAR_SIZE - 2), Vector2::Zero, planetColor});
+        vertices.push_back({Vector2::Zero, Vector2::Zero, planetColor});
+    }
+    createHUDMesh(hudCache.radarPlanet, vertices);
+
+    vertices.clear();
+    auto arrowColor = Color(.75f, 0, .75f, .75f);
+    auto a90 = DirectX::XM_PI / 2;
+    Vector2 tip = -Vector2(std::cosf(a90), std::sinf(a90)) * RADAR_SIZE;
+    vertices.push_back({Vector2::Zero, Vector2::Zero, arrowColor});
+    vertices.push_back({tip, Vector2::Zero, arrowColor});
+    vertices.push_back({tip, Vector2::Zero, arrowColor});
+    vertices.push_back({-Vector2(std::cosf(a90 + .1f), std::sinf(a90 + .1f)) * (RADAR_SIZE - 10), Vector2::Zero, arrowColor});
+    vertices.push_back({tip, Vector2::Zero, arrowColor});
+    vertices.push_back({-Vector2(std::cosf(a90 - .1f), std::sinf(a90 - .1f)) * (RADAR_SIZE - 10), Vector2::Zero, arrowColor});
+    createHUDMesh(hudCache.radarArrow, vertices);
 }
 
 void drawHUD()
 {
+    updateHUDCache();
+    oRenderer->setupFor2D();
+    oRenderer->renderStates.blendMode = OBlendPreMultiplied;
+    oRenderer->renderStates.primitiveMode = OPrimitiveTriangleList;
+    drawMesh(Matrix::Identity, hudCache.radarBackdrop);
     if (pMainPart)
     {
-        Vector2 radarPos = Vector2(OScreenWf - MINIMAP_SIZE / 2, OScreenHf - MINIMAP_SIZE / 2);
-        float radarSize = 60;
         auto planetVector = pMainPart->position;
         float shipAngle = std::atan2f(planetVector.x, -planetVector.y);
-        oPrimitiveBatch->begin(OPrimitiveLineStrip);
-        for (int i = 0; i <= 360; i += 15)
-        {
-            float angle = DirectX::XMConvertToRadians((float)i) + shipAngle;
-            oPrimitiveBatch->draw(radarPos + Vector2(std::cosf(angle) * radarSize, std::sinf(angle) * radarSize));
-        }
-        oPrimitiveBatch->end();
-        oPrimitiveBatch->begin(OPrimitiveLineList);
-        for (int i = 0; i <= 360; i += 15)
-        {
-            float angle = DirectX::XMConvertToRadians((float)i) + shipAngle;
-            float dist = 3;
-            if (i % 45) dist = 6;
-            oPrimitiveBatch->draw(radarPos + Vector2(std::cosf(angle) * radarSize, std::sinf(angle) * radarSize));
-            oPrimitiveBatch->draw(radarPos + Vector2(std::cosf(angle) * (radarSize + dist), std::sinf(angle) * (radarSize + dist)));
-        }
-        oPrimitiveBatch->end();
-        oPrimitiveBatch->begin(OPrimitiveTriangleList);
-        Color planetColor(0, .5f, 0, .75f);
-        planetColor = planetColor.AdjustedSaturation(.5f);
-        for (int i = 0; i < 180; i += 15)
-        {
-            float angle1 = DirectX::XMConvertToRadians((float)i) + shipAngle;
-            float angle2 = DirectX::XMConvertToRadians((float)i + 15) + shipAngle;
-            oPrimitiveBatch->draw(radarPos + Vector2(std::cosf(angle1) * (radarSize - 2), std::sinf(angle1) * (radarSize - 2)), planetColor);
-            oPrimitiveBatch->draw(radarPos + Vector2(std::cosf(angle2) * (radarSize - 2), std::sinf(angle2) * (radarSize - 2)), planetColor);
-            oPrimitiveBatch->draw(radarPos, planetColor);
-        }
-        auto arrowColor = Color(1, 0, 1, .75f);
-        oPrimitiveBatch->end();
-        oPrimitiveBatch->begin(OPrimitiveLineList);
-        oPrimitiveBatch->draw(radarPos, arrowColor);
-        auto a90 = DirectX::XM_PI / 2;
-        oPrimitiveBatch->draw(radarPos - Vector2(std::cosf(pMainPart->angle + a90) * radarSize, std::sinf(pMainPart->angle + a90) * radarSize), arrowColor);
-        oPrimitiveBatch->draw(radarPos - Vector2(std::cosf(pMainPart->angle + a90) * radarSize, std::sinf(pMainPart->angle + a90) * radarSize), arrowColor);
-        oPrimitiveBatch->draw(radarPos - Vector2(std::cosf(pMainPart->angle + a90 + .1f) * (radarSize - 10), std::sinf(pMainPart->angle + a90 + .1f) * (radarSize - 10)), arrowColor);
-        oPrimitiveBatch->draw(radarPos - Vector2(std::cosf(pMainPart->angle + a90) * radarSize, std::sinf(pMainPart->angle + a90) * radarSize), arrowColor);
-        oPrimitiveBatch->draw(radarPos - Vector2(std::cosf(pMainPart->angle + a90 - .1f) * (radarSize - 10), std::sinf(pMainPart->angle + a90 - .1f) * (radarSize - 10)), arrowColor);
-        oPrimitiveBatch->end();
+        auto radarTransform = Matrix::CreateRotationZ(shipAngle) * Matrix::CreateTranslation(hudCache.radarPos.x, hudCache.radarPos.y, 0);
+        oRenderer->renderStates.primitiveMode = OPrimitiveLineList;
+        drawMesh(radarTransform, hudCache.radarLines);
+        oRenderer->renderStates.primitiveMode = OPrimitiveTriangleList;
+        drawMesh(radarTransform, hudCache.radarPlanet);
+        oRenderer->renderStates.primitiveMode = OPrimitiveLineList;
+        drawMesh(Matrix::CreateRotationZ(pMainPart->angle) * Matrix::CreateTranslation(hudCache.radarPos.x, hudCache.radarPos.y, 0), hudCache.radarArrow);
     }
 }
 
@@ -684,9 +811,10 @@ void drawStages()
     oSpriteBatch->drawRect(nullptr, {0, 0, 132.f, OScreenHf}, Color(0, 0, 0, .5f));
     Vector2 stageTextPos(20.0f, 20.0f);
     int stageId = stageCount;
+    static CachedTexts stageTexts;
     for (auto& stage : stages)
     {
-        g_pFont->draw("--- Stage " + std::to_string(stageId) + " ---", stageTextPos, OTopLeft, Color(1, 1, 1));
+        g_pFont->draw(formatText(getCachedText(stageTexts, stageId), "--- Stage %i ---", stageId), stageTextPos, OTopLeft, Color(1, 1, 1));
         stageTextPos.y += 16;
         for (auto pPart : stage)
         {
@@ -718,6 +846,8 @@ void drawStages()
 void render()
 {
     oRenderer->clear({0, 0, 0, 1});
+    resetCullStats();
+    resetRenderQueueStats();
     oSpriteBatch->changeFiltering(OFilterNearest);
     oRenderer->renderStates.sampleFiltering = OFilterNearest;
 
@@ -732,10 +862,9 @@ void render()
         {
             drawWorld();
             drawParts();
-            oSpriteBatch->begin();
-            oRenderer->set2DCameraOffCenter(cameraPos, zoom);
             drawParticles();
-            oSpriteBatch->end();
+            oRenderer->set2DCameraOffCenter(cameraPos, zoom);
+            flushRenderQueue();
             drawStages();
             drawMiniMap();
             drawHUD();
@@ -745,10 +874,9 @@ void render()
         {
             drawWorld();
             drawParts();
-            oSpriteBatch->begin();
-            oRenderer->set2DCameraOffCenter(cameraPos, zoom);
             drawParticles();
-            oSpriteBatch->end();
+            oRenderer->set2DCameraOffCenter(cameraPos, zoom);
+            flushRenderQueue();
             drawStages();
             drawMiniMap();
             drawHUD();
@@ -765,12 +893,28 @@ void render()
     }
     Color altColor = Color(1.5, 1, 0, 1);
     oSpriteBatch->drawRect(nullptr, {OScreenCenterXf - 50, 0, 100, 32}, Color(0, 0, 0, .5f));
-    g_pFont->draw("ALT: " + std::to_string((int)altitude) + " m", {OScreenCenterXf, 4}, OTop, altColor);
-    g_pFont->draw("SPD: " + std::to_string((int)speed) + " m/s", {OScreenCenterXf, 20.0f}, OTop, altColor);
-    g_pFont->draw("FPS: " + std::to_string(oTiming->getFPS()), Vector2::Zero, OTopLeft, Color(0, .8f, 0, 1));
+    static CachedText altText, speedText, fpsText, particlesText, cullText, batchesText, massText, coverageText;
+    g_pFont->draw(formatText(altText, "ALT: %i m", (int)altitude), {OScreenCenterXf, 4}, OTop, altColor);
+    g_pFont->draw(formatText(speedText, "SPD: %i m/s", (int)speed), {OScreenCenterXf, 20.0f}, OTop, altColor);
+    g_pFont->draw(formatText(fpsText, "FPS: %i", (int)oTiming->getFPS()), Vector2::Zero, OTopLeft, Color(0, .8f, 0, 1));
+    g_pFont->draw(formatText(particlesText, "PARTICLES: %i / %i  DROPPED: %i/s  FALLBACKS: %i",
+                             particles.count, PARTICLE_BUDGET, getDroppedParticleCount(), getFallbackParticleCount()),
+                  {0, 16}, OTopLeft, Color(0, .8f, 0, 1));
+    g_pFont->draw(formatText(cullText, "DRAWN: %i VEHICLES, %i PARTICLES  CULLED: %i VEHICLES, %i PARTICLES",
+                             cullStats.vehiclesDrawn, cullStats.particlesDrawn, cullStats.vehiclesCulled, cullStats.particlesCulled),
+                  {0, 32}, OTopLeft, Color(0, .8f, 0, 1));
+    g_pFont->draw(formatText(batchesText, "BATCHES: %i / %i COMMANDS  CHANGES: %i TEX, %i BLEND, %i VB, %i XFORM",
+                             renderQueueStats.batches, renderQueueStats.commands, renderQueueStats.textureChanges,
+                             renderQueueStats.blendChanges, renderQueueStats.bufferChanges, renderQueueStats.transformChanges),
+                  {0, 48}, OTopLeft, Color(0, .8f, 0, 1));
     if (pMainPart)
     {
-        g_pFont->draw("MASS: " + std::to_string((int)(pMainPart->totalMass / 20.0f * 1000.0f)) + " Kg", {OScreenCenterXf - 200, OScreenHf - 4}, OBottom, altColor);
+        g_pFont->draw(formatText(massText, "MASS: %i Kg", (int)(pMainPart->totalMass / 20.0f * 1000.0f)), {OScreenCenterXf - 200, OScreenHf - 4}, OBottom, altColor);
+    }
+
+    if (isAutopilotOn && gameState == GAME_STATE_FLIGHT)
+    {
+        g_pFont->draw("AUTOPILOT", {OScreenCenterXf, 36.0f}, OTop, Color(1, 0, 1, 1));
     }
 
     if (hasStableOrbit)
@@ -778,6 +922,11 @@ void render()
         g_pFont->draw("STABLE ORBIT", {OScreenWf - MINIMAP_SIZE / 2, 0}, OTop, Color(orbitIndicatorAnim.get()));
     }
 
+    if (satelliteCatalog.size())
+    {
+        g_pFont->draw(formatText(coverageText, "COVERAGE: %i%%", (int)getCoveragePercent()), {OScreenWf - MINIMAP_SIZE / 2, MINIMAP_SIZE}, OBottom, Color(0, 1, 1));
+    }
+
     oSpriteBatch->end();
 }
 
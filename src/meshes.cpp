@@ -1,14 +1,20 @@
 #include "meshes.h"
-#include <onut/Random.h>
+#include "renderqueue.h"
+#include "rng.h"
+#include "terrain.h"
 #include <onut/Renderer.h>
+#include <algorithm>
 #include <vector>
 #include <onut/Curve.h>
 
 Mesh starMesh;
 Mesh atmosphereMesh;
 Mesh planetMesh;
+Mesh atmosphereArcMesh;
+Mesh planetArcMesh;
 Mesh launchStationMesh;
 Mesh cloudMesh;
+Mesh backgroundMesh;
 
 Mesh solidRocketMesh;
 Mesh coneMesh;
@@ -34,6 +40,26 @@ void createCircle(Vertices& vertices, Indices& indices, const Vector2& center, f
     }
 }
 
+void createTerrain(Vertices& vertices, Indices& indices, const Color& color)
+{
+    vertices.push_back({Vector2::Zero, Vector2::Zero, color});
+    int vertexOffset = vertices.size();
+    for (int i = 0; i < TERRAIN_SAMPLES; ++i)
+    {
+        // Same winding as createCircle
+        Mesh::Vertex vertex;
+        float angle = -((float)i / (float)TERRAIN_SAMPLES) * DirectX::XM_2PI;
+        float radius = getSurfaceRadius(angle);
+        vertex.position.x = std::cosf(angle) * radius;
+        vertex.position.y = std::sinf(angle) * radius;
+        vertex.color = color;
+        vertices.push_back(vertex);
+        indices.push_back(vertexOffset - 1);
+        indices.push_back(vertexOffset + i);
+        indices.push_back(vertexOffset + ((i + 1) % TERRAIN_SAMPLES));
+    }
+}
+
 void createCylinder(Vertices& vertices, Indices& indices, const Vector2& base, float radius, float height, const Color& color)
 {
     Mesh::Vertex vertex;
@@ -209,20 +235,192 @@ void createPlanet()
 {
     Vertices vertices;
     Indices indices;
-    createCircle(vertices, indices, {0, 0}, PLANET_SIZE, PLANET_COLOR, PLANET_SIDES);
+    createTerrain(vertices, indices, PLANET_COLOR);
     planetMesh.pVB = OVertexBuffer::createStatic(vertices.data(), vertices.size() * sizeof(Mesh::Vertex));
     planetMesh.pIB = OIndexBuffer::createStatic(indices.data(), indices.size() * sizeof(uint16_t));
     planetMesh.indexCount = indices.size();
 }
 
+#define ARC_MAX_ERROR .25f          // Pixels between a circle and its segments
+#define ARC_MIN_PIXELS 2.0f         // Shortest terrain segment on screen
+#define ARC_MIN_SEGMENTS 64         // Per turn
+#define ARC_MAX_TURN_SEGMENTS 65536
+#define ARC_MAX_SEGMENTS 4096       // Per arc mesh, keeps the atmosphere in 16 bits indices
+#define ARC_MIN_MARGIN 4            // Segments built past each side of the view
+
+// Segment range of a turn split in segments (a power of 2). Can go past a
+// turn on either side, angles wrap.
+struct ArcRange
+{
+    int segments = 0;
+    int first = 0;
+    int last = 0;
+};
+
+static ArcRange atmosphereArc;
+static ArcRange planetArc;
+
+static int nextPowerOf2(float value)
+{
+    int result = ARC_MIN_SEGMENTS;
+    while (result < ARC_MAX_TURN_SEGMENTS && (float)result < value) result <<= 1;
+    return result;
+}
+
+// Segments per turn so a circle of radius stays within ARC_MAX_ERROR pixels.
+// The sagitta of a segment of angle a is radius * a^2 / 8.
+static int getCircleSegments(float radius, float zoom)
+{
+    float angle = std::sqrtf(8.0f * ARC_MAX_ERROR / (radius * zoom));
+    return nextPowerOf2(DirectX::XM_2PI / angle);
+}
+
+// Terrain is linear between samples, so the samples themselves unless they
+// get closer than ARC_MIN_PIXELS on screen
+static int getTerrainSegments(float zoom)
+{
+    int segments = std::max(getCircleSegments((float)PLANET_SIZE, zoom),
+                            nextPowerOf2(DirectX::XM_2PI * (float)PLANET_SIZE * zoom / ARC_MIN_PIXELS));
+    return std::min(segments, TERRAIN_SAMPLES);
+}
+
+// Angles (atan2) the camera rect spans, false when it sees the whole turn
+static bool getVisibleAngles(const Rect& rect, float& from, float& to)
+{
+    if (rect.x <= 0 && rect.y <= 0 && rect.x + rect.z >= 0 && rect.y + rect.w >= 0) return false;
+
+    // The rect is convex and doesn't hold the center, so its corners bound it
+    Vector2 corners[] = {
+        Vector2(rect.x, rect.y),
+        Vector2(rect.x + rect.z, rect.y),
+        Vector2(rect.x, rect.y + rect.w),
+        Vector2(rect.x + rect.z, rect.y + rect.w),
+    };
+    float centerAngle = std::atan2f(rect.y + rect.w * .5f, rect.x + rect.z * .5f);
+    from = to = centerAngle;
+    for (auto& corner : corners)
+    {
+        float angle = std::remainderf(std::atan2f(corner.y, corner.x) - centerAngle, DirectX::XM_2PI);
+        from = std::min(from, centerAngle + angle);
+        to = std::max(to, centerAngle + angle);
+    }
+    return true;
+}
+
+// Returns true when arc no longer covers the view and was moved
+static bool updateArcRange(ArcRange& arc, int segments, bool isFullTurn, float from, float to)
+{
+    int first = 0;
+    int last = segments;
+    if (isFullTurn)
+    {
+        segments = std::min(segments, ARC_MAX_SEGMENTS);
+        last = segments;
+    }
+    else
+    {
+        // Too wide for one mesh at that detail, coarser
+        while (segments > ARC_MIN_SEGMENTS && (to - from) * (float)segments / DirectX::XM_2PI > (float)(ARC_MAX_SEGMENTS / 2)) segments >>= 1;
+        float segmentsPerRadian = (float)segments / DirectX::XM_2PI;
+        first = (int)std::floorf(from * segmentsPerRadian);
+        last = (int)std::ceilf(to * segmentsPerRadian);
+    }
+    if (segments == arc.segments)
+    {
+        if (arc.last - arc.first >= segments) return false;
+        if (first >= arc.first && last <= arc.last) return false;
+    }
+
+    // Build past the view so panning only rebuilds once in a while
+    int margin = std::max(ARC_MIN_MARGIN, last - first);
+    margin = std::min(margin, (ARC_MAX_SEGMENTS - (last - first)) / 2);
+    arc.segments = segments;
+    arc.first = first - margin;
+    arc.last = last + margin;
+    if (arc.last - arc.first >= segments)
+    {
+        arc.first = 0;
+        arc.last = segments;
+    }
+    return true;
+}
+
+static void buildAtmosphereArc()
+{
+    Vertices vertices;
+    Indices indices;
+    float step = DirectX::XM_2PI / (float)atmosphereArc.segments;
+    int sides = atmosphereArc.last - atmosphereArc.first;
+    for (int a = 0; a < ATMOSPHERES_COUNT; ++a)
+    {
+        // Same bands as createAtmospheres
+        float d1 = ((float)a + 1);
+        float d2 = ((float)a);
+        d1 *= d1;
+        d2 *= d2;
+        d1 = PLANET_SIZE + PLANET_SIZE * ATMOSPHERES_SCALE * d1;
+        d2 = PLANET_SIZE + PLANET_SIZE * ATMOSPHERES_SCALE * d2;
+        uint16_t vertexOffset = (uint16_t)vertices.size();
+        for (int i = 0; i <= sides; ++i)
+        {
+            float angle = (float)(atmosphereArc.first + i) * step;
+            Vector2 dir(std::cosf(angle), std::sinf(angle));
+            vertices.push_back({dir * d1, Vector2::Zero, ATMOSPHERE_COLORS[a + 1]});
+            vertices.push_back({dir * d2, Vector2::Zero, ATMOSPHERE_COLORS[a]});
+        }
+        for (int i = 0; i < sides; ++i)
+        {
+            uint16_t outer = vertexOffset + i * 2;
+            for (auto index : {0, 1, 2, 2, 1, 3}) indices.push_back(outer + index);
+        }
+    }
+    atmosphereArcMesh.pVB = OVertexBuffer::createStatic(vertices.data(), vertices.size() * sizeof(Mesh::Vertex));
+    atmosphereArcMesh.pIB = OIndexBuffer::createStatic(indices.data(), indices.size() * sizeof(uint16_t));
+    atmosphereArcMesh.indexCount = indices.size();
+}
+
+static void buildPlanetArc()
+{
+    Vertices vertices;
+    Indices indices;
+    float step = DirectX::XM_2PI / (float)planetArc.segments;
+    int sides = planetArc.last - planetArc.first;
+    vertices.push_back({Vector2::Zero, Vector2::Zero, PLANET_COLOR});
+    for (int i = 0; i <= sides; ++i)
+    {
+        float angle = (float)(planetArc.first + i) * step;
+        float radius = getSurfaceRadius(angle);
+        vertices.push_back({Vector2(std::cosf(angle) * radius, std::sinf(angle) * radius), Vector2::Zero, PLANET_COLOR});
+        if (i < sides)
+        {
+            // Same winding as createTerrain, which goes the other way around
+            indices.push_back(0);
+            indices.push_back((uint16_t)(i + 2));
+            indices.push_back((uint16_t)(i + 1));
+        }
+    }
+    planetArcMesh.pVB = OVertexBuffer::createStatic(vertices.data(), vertices.size() * sizeof(Mesh::Vertex));
+    planetArcMesh.pIB = OIndexBuffer::createStatic(indices.data(), indices.size() * sizeof(uint16_t));
+    planetArcMesh.indexCount = indices.size();
+}
+
+void updatePlanetArcs(const Rect& cameraRect, float zoom)
+{
+    float from = 0, to = 0;
+    bool isFullTurn = !getVisibleAngles(cameraRect, from, to);
+    float atmosphereRadius = PLANET_SIZE + PLANET_SIZE * ATMOSPHERES_SCALE * (float)(ATMOSPHERES_COUNT * ATMOSPHERES_COUNT);
+    if (updateArcRange(atmosphereArc, getCircleSegments(atmosphereRadius, zoom), isFullTurn, from, to)) buildAtmosphereArc();
+    if (updateArcRange(planetArc, getTerrainSegments(zoom), isFullTurn, from, to)) buildPlanetArc();
+}
+
 void createStars()
 {
     Mesh::Vertex vertices[STAR_COUNT];
     for (int i = 0; i < STAR_COUNT; ++i)
     {
         auto& vertex = vertices[i];
-        vertex.position = ORandVector2(Vector2(800, 600));
-        vertex.color = Color::White * ORandFloat(.25f, 1);
+        vertex.position = randVector2(RANDOM_STREAM_EFFECTS, Vector2::Zero, Vector2(800, 600));
+        vertex.color = Color::White * randFloat(RANDOM_STREAM_EFFECTS, .25f, 1);
     }
     starMesh.pVB = OVertexBuffer::createStatic(vertices, sizeof(vertices));
     starMesh.indexCount = STAR_COUNT;
@@ -249,6 +447,29 @@ void createCone()
     coneMesh.indexCount = indices.size();
 }
 
+void createBackground()
+{
+    // Where drawWorld used to drawRect BGstuff.png and BGscaffold.png
+    Rect rects[] = {
+        Rect(-346.0f / 64.0f, -PLANET_SIZE - 168.0f / 64.0f, 791.0f / 64.0f, 588.0f / 64.0f),
+        Rect(-51.0f / 64.0f + .5f, -PLANET_SIZE - 660.0f / 64.0f, 339.0f / 64.0f, 681.0f / 64.0f),
+    };
+    Vertices vertices;
+    Indices indices;
+    for (auto& rect : rects)
+    {
+        uint16_t vertexOffset = (uint16_t)vertices.size();
+        vertices.push_back({Vector2(rect.x, rect.y), Vector2(0, 0), Color::White});
+        vertices.push_back({Vector2(rect.x, rect.y + rect.w), Vector2(0, 1), Color::White});
+        vertices.push_back({Vector2(rect.x + rect.z, rect.y + rect.w), Vector2(1, 1), Color::White});
+        vertices.push_back({Vector2(rect.x + rect.z, rect.y), Vector2(1, 0), Color::White});
+        for (auto index : {0, 1, 2, 0, 2, 3}) indices.push_back(vertexOffset + index);
+    }
+    backgroundMesh.pVB = OVertexBuffer::createStatic(vertices.data(), vertices.size() * sizeof(Mesh::Vertex));
+    backgroundMesh.pIB = OIndexBuffer::createStatic(indices.data(), indices.size() * sizeof(uint16_t));
+    backgroundMesh.indexCount = indices.size();
+}
+
 void createMeshes()
 {
     createAtmospheres();
@@ -256,6 +477,7 @@ void createMeshes()
     createStars();
     createSolidRocket();
     createCone();
+    createBackground();
 }
 
 extern OTextureRef pWhiteTexture;
@@ -276,3 +498,8 @@ void drawMesh(const Matrix& transform, const Mesh& mesh)
     oRenderer->renderStates.vertexBuffer = mesh.pVB;
     oRenderer->draw(mesh.indexCount);
 }
+
+void queueMeshIndexed(int layer, const Matrix& transform, const Mesh& mesh)
+{
+    queueDraw(layer, OBlendPreMultiplied, pWhiteTexture, mesh.pVB, mesh.pIB, transform, 0, mesh.indexCount);
+}
@@ -20,12 +20,17 @@ struct Mesh
 extern Mesh starMesh;
 extern Mesh atmosphereMesh;
 extern Mesh planetMesh;
+extern Mesh atmosphereArcMesh;  // Only the part of atmosphereMesh in view
+extern Mesh planetArcMesh;      // Only the part of planetMesh in view
 extern Mesh launchStationMesh;
 extern Mesh cloudMesh;
+extern Mesh backgroundMesh; // Launch pad then scaffolding, 6 indices each
 
 extern Mesh solidRocketMesh;
 extern Mesh coneMesh;
 
 void createMeshes();
+void updatePlanetArcs(const Rect& cameraRect, float zoom); // Rebuilds the arc meshes when the view left them
 void drawMeshIndexed(const Matrix& transform, const Mesh& mesh);
 void drawMesh(const Matrix& transform, const Mesh& mesh);
+void queueMeshIndexed(int layer, const Matrix& transform, const Mesh& mesh);
@@ -0,0 +1,547 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ojam16sim.h"
+#include "physics.h"
+#include "terrain.h"
+
+// Same values as PART_TYPE_* in part.h, which can't be included without the engine
+#define SIM_PART_PAYLOAD 0
+#define SIM_PART_BOOSTER 1
+#define SIM_PART_DECOUPLER 2
+#define SIM_PART_SATELLITE 5
+#define SIM_PART_ENGINE 6
+
+struct SimPartDef
+{
+    float weight = 0;
+    float liquidFuel = 0;
+    float solidFuel = 0;
+    float stability = 0;
+    float trust = 0;
+    float burn = 0;
+    int type = 0;
+    int id = 0;
+};
+
+struct ojsim_catalog
+{
+    std::vector<SimPartDef> defs;
+    std::unordered_map<int, int> idToDef;
+    int satelliteDef = -1;
+};
+
+struct SimForce
+{
+    PhysicsForce force;
+    int root;
+};
+
+struct ojsim_sim
+{
+    const ojsim_catalog* pCatalog;
+    uint32_t rng;
+
+    // Per part. Parents always come before their children, decoupled parts
+    // become roots in place so that stays true.
+    std::vector<float> floats[OJSIM_FLOAT_FIELD_COUNT];
+    std::vector<int> ints[OJSIM_INT_FIELD_COUNT];
+    std::vector<int> def;
+    std::vector<int> root;
+
+    // Per root, rebuilt every tick
+    std::vector<float> totalMass;
+    std::vector<float> centerOfMassX;
+    std::vector<float> centerOfMassY;
+    std::vector<float> stability;
+    std::vector<SimForce> forces;
+
+    int nextStage = -1;
+    int steering = 0;
+    float time = 0;
+    bool isFlying = false;
+    bool hasDeployed = false;
+};
+
+static std::once_flag terrainOnce;
+
+//--- Catalog
+
+static std::vector<std::string> splitCSVLine(const std::string& line)
+{
+    std::vector<std::string> ret(1);
+    bool isQuoted = false;
+    for (auto c : line)
+    {
+        if (c == '"') isQuoted = !isQuoted;
+        else if (c == ',' && !isQuoted) ret.push_back({});
+        else if (c != '\r') ret.back().push_back(c);
+    }
+    return ret;
+}
+
+static float toFloat(const std::string& value)
+{
+    return value.empty() ? 0.0f : std::stof(value);
+}
+
+ojsim_catalog* ojsim_catalog_load(const char* partsCsvPath)
+{
+    std::ifstream file(partsCsvPath);
+    if (!file.is_open()) return nullptr;
+
+    std::string line;
+    if (!std::getline(file, line)) return nullptr;
+    std::unordered_map<std::string, int> columns;
+    auto header = splitCSVLine(line);
+    for (int i = 0; i < (int)header.size(); ++i) columns[header[i]] = i;
+    static const char* REQUIRED_COLUMNS[] = {"id", "type", "mass", "fuel", "trust", "burn", "stability"};
+    for (auto column : REQUIRED_COLUMNS)
+    {
+        if (columns.find(column) == columns.end()) return nullptr;
+    }
+
+    static const std::unordered_map<std::string, int> TYPES = {
+        {"PAYLOAD", SIM_PART_PAYLOAD},
+        {"BOOSTER", SIM_PART_BOOSTER},
+        {"DECOUPLER", SIM_PART_DECOUPLER},
+        {"AERODYNAMIC", 3},
+        {"FUEL", 4},
+        {"SATELLITE", SIM_PART_SATELLITE},
+        {"ENGINE", SIM_PART_ENGINE},
+    };
+
+    auto pCatalog = new ojsim_catalog();
+    try
+    {
+        while (std::getline(file, line))
+        {
+            if (line.empty() || line == "\r") continue;
+            auto values = splitCSVLine(line);
+            values.resize(header.size());
+            SimPartDef partDef;
+            auto it = TYPES.find(values[columns["type"]]);
+            partDef.type = it == TYPES.end() ? 0 : it->second;
+            partDef.id = std::stoi(values[columns["id"]]);
+            partDef.weight = toFloat(values[columns["mass"]]);
+            if (partDef.type == SIM_PART_BOOSTER) partDef.solidFuel = toFloat(values[columns["fuel"]]);
+            else partDef.liquidFuel = toFloat(values[columns["fuel"]]);
+            partDef.trust = toFloat(values[columns["trust"]]);
+            partDef.burn = toFloat(values[columns["burn"]]);
+            partDef.stability = toFloat(values[columns["stability"]]);
+            if (partDef.type == SIM_PART_SATELLITE && pCatalog->satelliteDef == -1)
+            {
+                pCatalog->satelliteDef = (int)pCatalog->defs.size();
+            }
+            pCatalog->idToDef[partDef.id] = (int)pCatalog->defs.size();
+            pCatalog->defs.push_back(partDef);
+        }
+    }
+    catch (...)
+    {
+        delete pCatalog;
+        return nullptr;
+    }
+
+    std::call_once(terrainOnce, initTerrain);
+    return pCatalog;
+}
+
+void ojsim_catalog_free(ojsim_catalog* pCatalog)
+{
+    delete pCatalog;
+}
+
+int ojsim_catalog_get_part_count(const ojsim_catalog* pCatalog)
+{
+    return pCatalog ? (int)pCatalog->defs.size() : 0;
+}
+
+int ojsim_get_api_version(void)
+{
+    return OJSIM_API_VERSION;
+}
+
+//--- Simulation
+
+ojsim_sim* ojsim_create(const ojsim_catalog* pCatalog, unsigned int seed)
+{
+    if (!pCatalog) return nullptr;
+    auto pSim = new ojsim_sim();
+    pSim->pCatalog = pCatalog;
+    pSim->rng = seed ? seed : 1;
+    return pSim;
+}
+
+void ojsim_destroy(ojsim_sim* pSim)
+{
+    delete pSim;
+}
+
+static float randFloat(ojsim_sim* pSim, float from, float to)
+{
+    auto& x = pSim->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return from + (to - from) * (float)(x >> 8) / 16777216.0f;
+}
+
+int ojsim_add_part(ojsim_sim* pSim, int partId, int parent, float x, float y, float angle, int stage)
+{
+    if (!pSim || pSim->isFlying) return -1;
+    auto it = pSim->pCatalog->idToDef.find(partId);
+    if (it == pSim->pCatalog->idToDef.end()) return -1;
+    int index = (int)pSim->def.size();
+    if (index == 0 ? parent != -1 : (parent < 0 || parent >= index)) return -1;
+
+    auto& partDef = pSim->pCatalog->defs[it->second];
+    float values[OJSIM_FLOAT_FIELD_COUNT] = {x, y, angle, 0, 0, 0, partDef.liquidFuel, partDef.solidFuel, 0, 0, 0};
+    for (int i = 0; i < OJSIM_FLOAT_FIELD_COUNT; ++i) pSim->floats[i].push_back(values[i]);
+    pSim->ints[OJSIM_FIELD_PARENT].push_back(parent);
+    pSim->ints[OJSIM_FIELD_PART_ID].push_back(partId);
+    pSim->ints[OJSIM_FIELD_STAGE].push_back(stage);
+    pSim->ints[OJSIM_FIELD_FLAGS].push_back(0);
+    pSim->def.push_back(it->second);
+    pSim->root.push_back(0);
+    pSim->nextStage = std::max(pSim->nextStage, stage);
+    return index;
+}
+
+int ojsim_get_part_count(const ojsim_sim* pSim)
+{
+    return pSim ? (int)pSim->def.size() : 0;
+}
+
+const float* ojsim_get_part_floats(const ojsim_sim* pSim, int field)
+{
+    if (!pSim || field < 0 || field >= OJSIM_FLOAT_FIELD_COUNT) return nullptr;
+    return pSim->floats[field].data();
+}
+
+const int* ojsim_get_part_ints(const ojsim_sim* pSim, int field)
+{
+    if (!pSim || field < 0 || field >= OJSIM_INT_FIELD_COUNT) return nullptr;
+    return pSim->ints[field].data();
+}
+
+void ojsim_set_steering(ojsim_sim* pSim, int direction)
+{
+    if (pSim) pSim->steering = std::max(-1, std::min(1, direction));
+}
+
+static bool isAlive(const ojsim_sim* pSim, int i)
+{
+    return !(pSim->ints[OJSIM_FIELD_FLAGS][i] & OJSIM_PART_DEAD);
+}
+
+// Same composition as getWorldTransform
+static void updateWorldTransforms(ojsim_sim* pSim)
+{
+    auto x = pSim->floats[OJSIM_FIELD_X].data();
+    auto y = pSim->floats[OJSIM_FIELD_Y].data();
+    auto angle = pSim->floats[OJSIM_FIELD_ANGLE].data();
+    auto worldX = pSim->floats[OJSIM_FIELD_WORLD_X].data();
+    auto worldY = pSim->floats[OJSIM_FIELD_WORLD_Y].data();
+    auto worldAngle = pSim->floats[OJSIM_FIELD_WORLD_ANGLE].data();
+    auto parent = pSim->ints[OJSIM_FIELD_PARENT].data();
+    int count = (int)pSim->def.size();
+    for (int i = 0; i < count; ++i)
+    {
+        int p = parent[i];
+        if (p < 0)
+        {
+            worldX[i] = x[i];
+            worldY[i] = y[i];
+            worldAngle[i] = angle[i];
+            pSim->root[i] = i;
+        }
+        else
+        {
+            float c = std::cos(worldAngle[p]);
+            float s = std::sin(worldAngle[p]);
+            worldX[i] = worldX[p] + x[i] * c - y[i] * s;
+            worldY[i] = worldY[p] + x[i] * s + y[i] * c;
+            worldAngle[i] = worldAngle[p] + angle[i];
+            pSim->root[i] = pSim->root[p];
+        }
+    }
+}
+
+// Same rule as getLiquidFuel
+static int getLiquidFuelTank(const ojsim_sim* pSim, int i)
+{
+    auto& defs = pSim->pCatalog->defs;
+    auto parent = pSim->ints[OJSIM_FIELD_PARENT].data();
+    auto liquidFuel = pSim->floats[OJSIM_FIELD_LIQUID_FUEL].data();
+    return findLiquidFuelTank(i, -1,
+        [&](int part) { return parent[part]; },
+        [&](int part) { return defs[pSim->def[part]].type == SIM_PART_DECOUPLER; },
+        [&](int part) { return liquidFuel[part]; });
+}
+
+// Kills the part and everything attached under it, like explodePart
+static void killPart(ojsim_sim* pSim, int index)
+{
+    auto flags = pSim->ints[OJSIM_FIELD_FLAGS].data();
+    auto parent = pSim->ints[OJSIM_FIELD_PARENT].data();
+    flags[index] |= OJSIM_PART_DEAD;
+    int count = (int)pSim->def.size();
+    for (int i = index + 1; i < count; ++i)
+    {
+        if (parent[i] >= 0 && (flags[parent[i]] & OJSIM_PART_DEAD)) flags[i] |= OJSIM_PART_DEAD;
+    }
+}
+
+static void makeRoot(ojsim_sim* pSim, int i, float vx, float vy, float angleVelocity)
+{
+    pSim->floats[OJSIM_FIELD_X][i] = pSim->floats[OJSIM_FIELD_WORLD_X][i];
+    pSim->floats[OJSIM_FIELD_Y][i] = pSim->floats[OJSIM_FIELD_WORLD_Y][i];
+    pSim->floats[OJSIM_FIELD_ANGLE][i] = pSim->floats[OJSIM_FIELD_WORLD_ANGLE][i];
+    pSim->floats[OJSIM_FIELD_VEL_X][i] = vx;
+    pSim->floats[OJSIM_FIELD_VEL_Y][i] = vy;
+    pSim->floats[OJSIM_FIELD_ANGLE_VEL][i] = angleVelocity;
+    pSim->ints[OJSIM_FIELD_PARENT][i] = -1;
+}
+
+// Mirrors decouple in main.cpp, for centered decouplers
+static void decouple(ojsim_sim* pSim, int index)
+{
+    updateWorldTransforms(pSim);
+    auto parent = pSim->ints[OJSIM_FIELD_PARENT].data();
+    auto vx = pSim->floats[OJSIM_FIELD_VEL_X].data();
+    auto vy = pSim->floats[OJSIM_FIELD_VEL_Y].data();
+    auto angleVel = pSim->floats[OJSIM_FIELD_ANGLE_VEL].data();
+    int top = pSim->root[index];
+    float topVx = vx[top];
+    float topVy = vy[top];
+    float topAngleVel = angleVel[top];
+    float dirX, dirY;
+    getDecoupleKick(topVx, topVy, dirX, dirY);
+
+    int count = (int)pSim->def.size();
+    for (int i = index + 1; i < count; ++i)
+    {
+        if (parent[i] != index) continue;
+        makeRoot(pSim, i, topVx - dirX, topVy - dirY, topAngleVel + randFloat(pSim, -1, 1));
+    }
+    if (parent[index] >= 0)
+    {
+        vx[top] += dirX;
+        vy[top] += dirY;
+        makeRoot(pSim, index, topVx, topVy, topAngleVel + randFloat(pSim, -1, 1));
+    }
+    else
+    {
+        angleVel[index] += randFloat(pSim, -1, 1);
+    }
+}
+
+// Same apsis search as updateOrbit, so payloads deploy under the same conditions
+static bool hasStableOrbit(const ojsim_sim* pSim)
+{
+    auto& floats = pSim->floats;
+    return isStableOrbit(findApsides(floats[OJSIM_FIELD_X][0], floats[OJSIM_FIELD_Y][0],
+                                     floats[OJSIM_FIELD_VEL_X][0], floats[OJSIM_FIELD_VEL_Y][0]));
+}
+
+int ojsim_activate_next_stage(ojsim_sim* pSim)
+{
+    if (!pSim || pSim->def.empty()) return -1;
+    if (!pSim->isFlying)
+    {
+        // Lift off, the first stage fires right away like in the game
+        pSim->isFlying = true;
+    }
+    if (pSim->nextStage < 0 || !isAlive(pSim, 0)) return -1;
+
+    auto& defs = pSim->pCatalog->defs;
+    auto stage = pSim->ints[OJSIM_FIELD_STAGE].data();
+    auto flags = pSim->ints[OJSIM_FIELD_FLAGS].data();
+    int firing = pSim->nextStage--;
+    bool isStable = hasStableOrbit(pSim);
+    int count = (int)pSim->def.size();
+    for (int i = 0; i < count; ++i)
+    {
+        if (stage[i] != firing || !isAlive(pSim, i)) continue;
+        flags[i] |= OJSIM_PART_ACTIVE;
+        switch (defs[pSim->def[i]].type)
+        {
+            case SIM_PART_PAYLOAD:
+                if (isStable && pSim->pCatalog->satelliteDef != -1)
+                {
+                    pSim->def[i] = pSim->pCatalog->satelliteDef;
+                    flags[i] |= OJSIM_PART_SATELLITE;
+                    pSim->hasDeployed = true;
+                }
+                else
+                {
+                    killPart(pSim, i);
+                    return pSim->nextStage + 1;
+                }
+                break;
+            case SIM_PART_DECOUPLER:
+                decouple(pSim, i);
+                break;
+        }
+    }
+    return pSim->nextStage + 1;
+}
+
+static void tick(ojsim_sim* pSim, float dt)
+{
+    auto& defs = pSim->pCatalog->defs;
+    int count = (int)pSim->def.size();
+    auto x = pSim->floats[OJSIM_FIELD_X].data();
+    auto y = pSim->floats[OJSIM_FIELD_Y].data();
+    auto angle = pSim->floats[OJSIM_FIELD_ANGLE].data();
+    auto vx = pSim->floats[OJSIM_FIELD_VEL_X].data();
+    auto vy = pSim->floats[OJSIM_FIELD_VEL_Y].data();
+    auto angleVel = pSim->floats[OJSIM_FIELD_ANGLE_VEL].data();
+    auto liquidFuel = pSim->floats[OJSIM_FIELD_LIQUID_FUEL].data();
+    auto solidFuel = pSim->floats[OJSIM_FIELD_SOLID_FUEL].data();
+    auto worldX = pSim->floats[OJSIM_FIELD_WORLD_X].data();
+    auto worldY = pSim->floats[OJSIM_FIELD_WORLD_Y].data();
+    auto worldAngle = pSim->floats[OJSIM_FIELD_WORLD_ANGLE].data();
+    auto parent = pSim->ints[OJSIM_FIELD_PARENT].data();
+    auto flags = pSim->ints[OJSIM_FIELD_FLAGS].data();
+
+    updateWorldTransforms(pSim);
+    pSim->totalMass.assign(count, 0.0f);
+    pSim->centerOfMassX.assign(count, 0.0f);
+    pSim->centerOfMassY.assign(count, 0.0f);
+    pSim->stability.assign(count, 0.0f);
+    pSim->forces.clear();
+
+    // Mass, stability and thrust, like the first half of updatePart
+    for (int i = 0; i < count; ++i)
+    {
+        if (!isAlive(pSim, i)) continue;
+        auto& partDef = defs[pSim->def[i]];
+        int r = pSim->root[i];
+        float mass = partDef.weight + liquidFuel[i] + solidFuel[i];
+        if (parent[i] >= 0)
+        {
+            // The game weights by the position relative to the direct parent
+            pSim->centerOfMassX[r] += x[i] * mass;
+            pSim->centerOfMassY[r] += y[i] * mass;
+        }
+        pSim->totalMass[r] += mass;
+        pSim->stability[r] += partDef.stability;
+
+        if (!(flags[i] & OJSIM_PART_ACTIVE)) continue;
+        float* pFuel = nullptr;
+        if (partDef.type == SIM_PART_BOOSTER)
+        {
+            pFuel = &solidFuel[i];
+        }
+        else if (partDef.type == SIM_PART_ENGINE)
+        {
+            int tank = getLiquidFuelTank(pSim, i);
+            if (tank != -1) pFuel = &liquidFuel[tank];
+        }
+        if (pFuel && burnFuel(*pFuel, partDef.burn, dt))
+        {
+            pSim->forces.push_back({getThrust(worldX[i], worldY[i], worldAngle[i], partDef.trust), r});
+        }
+    }
+
+    // Steering only ever applies to the main vehicle
+    if (pSim->steering && isAlive(pSim, 0))
+    {
+        angleVel[0] += (float)pSim->steering * (10 + pSim->stability[0] * 4) / pSim->totalMass[0] * dt;
+    }
+
+    // Rigid body of every root, like the end of updatePart
+    for (int r = 0; r < count; ++r)
+    {
+        if (parent[r] >= 0 || !isAlive(pSim, r)) continue;
+        float totalMass = pSim->totalMass[r];
+        if (totalMass <= 0) continue;
+        float comX = pSim->centerOfMassX[r] / totalMass;
+        float comY = pSim->centerOfMassY[r] / totalMass;
+        RigidBody body = {x[r], y[r], angle[r], vx[r], vy[r], angleVel[r]};
+        for (auto& force : pSim->forces)
+        {
+            if (force.root == r) applyForce(body, comX, comY, totalMass, force.force, dt);
+        }
+        integrateBody(body, totalMass, pSim->stability[r], dt);
+        x[r] = body.x;
+        y[r] = body.y;
+        angle[r] = body.angle;
+        vx[r] = body.vx;
+        vy[r] = body.vy;
+        angleVel[r] = body.angleVelocity;
+    }
+
+    updateWorldTransforms(pSim);
+    for (int i = 0; i < count; ++i)
+    {
+        if (isAlive(pSim, i) && isUnderground(worldX[i], worldY[i])) killPart(pSim, i);
+    }
+    pSim->time += dt;
+}
+
+static void fillTelemetry(const ojsim_sim* pSim, ojsim_telemetry& telemetry)
+{
+    auto& floats = pSim->floats;
+    telemetry.time = pSim->time;
+    telemetry.x = floats[OJSIM_FIELD_X][0];
+    telemetry.y = floats[OJSIM_FIELD_Y][0];
+    telemetry.vx = floats[OJSIM_FIELD_VEL_X][0];
+    telemetry.vy = floats[OJSIM_FIELD_VEL_Y][0];
+    telemetry.angle = floats[OJSIM_FIELD_ANGLE][0];
+    telemetry.angleVelocity = floats[OJSIM_FIELD_ANGLE_VEL][0];
+    telemetry.altitude = std::sqrt(telemetry.x * telemetry.x + telemetry.y * telemetry.y) - PLANET_SIZE;
+    telemetry.speed = std::sqrt(telemetry.vx * telemetry.vx + telemetry.vy * telemetry.vy);
+    telemetry.mass = 0;
+    telemetry.liquidFuel = 0;
+    telemetry.solidFuel = 0;
+    int count = (int)pSim->def.size();
+    for (int i = 0; i < count; ++i)
+    {
+        if (pSim->root[i] != 0 || !isAlive(pSim, i)) continue;
+        telemetry.mass += pSim->pCatalog->defs[pSim->def[i]].weight + floats[OJSIM_FIELD_LIQUID_FUEL][i] + floats[OJSIM_FIELD_SOLID_FUEL][i];
+        telemetry.liquidFuel += floats[OJSIM_FIELD_LIQUID_FUEL][i];
+        telemetry.solidFuel += floats[OJSIM_FIELD_SOLID_FUEL][i];
+    }
+    telemetry.stagesLeft = pSim->nextStage + 1;
+    telemetry.flags = 0;
+    if (pSim->isFlying) telemetry.flags |= OJSIM_FLYING;
+    if (!isAlive(pSim, 0)) telemetry.flags |= OJSIM_CRASHED;
+    if (pSim->hasDeployed) telemetry.flags |= OJSIM_SATELLITE_DEPLOYED;
+}
+
+int ojsim_step(ojsim_sim* pSim, int tickCount, float dt, ojsim_telemetry* pTelemetry)
+{
+    if (!pSim || pSim->def.empty() || dt <= 0) return 0;
+    int ticks = 0;
+    for (; ticks < tickCount && isAlive(pSim, 0); ++ticks)
+    {
+        // Sitting on the pad until the first stage, like GAME_STATE_STAND_BY
+        if (pSim->isFlying) tick(pSim, dt);
+        else updateWorldTransforms(pSim);
+        if (pTelemetry) fillTelemetry(pSim, pTelemetry[ticks]);
+    }
+
+    // The apsis search is the most expensive part of a tick, only the last
+    // record gets it
+    if (pTelemetry && ticks > 0 && hasStableOrbit(pSim))
+    {
+        pTelemetry[ticks - 1].flags |= OJSIM_STABLE_ORBIT;
+    }
+    return ticks;
+}
+
+void ojsim_get_telemetry(ojsim_sim* pSim, ojsim_telemetry* pTelemetry)
+{
+    if (!pSim || pSim->def.empty() || !pTelemetry) return;
+    fillTelemetry(pSim, *pTelemetry);
+    if (hasStableOrbit(pSim)) pTelemetry->flags |= OJSIM_STABLE_ORBIT;
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+/*
+ * ojam16sim: headless flight simulation with a C ABI.
+ *
+ * Same rigid body physics as updatePart and the same staging rules as
+ * activateNextStage, without rendering, sound or particles. Orbit stability,
+ * which decides payload deploy and OJSIM_STABLE_ORBIT, is updateOrbit's apsis
+ * search, up to 3000 steps once in orbit. Telemetry only reports it on the
+ * last record of each ojsim_step call, so callers that sample pay for the
+ * search once per sample rather than every tick. A catalog is loaded once and
+ * can be shared read-only by any number of simulations. Simulations share
+ * nothing, each one may be stepped on its own thread.
+ */
+
+#ifdef _WIN32
+#ifdef OJSIM_EXPORTS
+#define OJSIM_API __declspec(dllexport)
+#else
+#define OJSIM_API __declspec(dllimport)
+#endif
+#else
+#define OJSIM_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OJSIM_API_VERSION 2
+
+typedef struct ojsim_catalog ojsim_catalog;
+typedef struct ojsim_sim ojsim_sim;
+
+/* Part flags */
+#define OJSIM_PART_ACTIVE 1
+#define OJSIM_PART_DEAD 2
+#define OJSIM_PART_SATELLITE 4
+
+/* Telemetry flags */
+#define OJSIM_FLYING 1
+#define OJSIM_CRASHED 2
+#define OJSIM_STABLE_ORBIT 4          /* Only on the last record of an ojsim_step call */
+#define OJSIM_SATELLITE_DEPLOYED 8
+
+/* Per part arrays, see ojsim_get_part_floats and ojsim_get_part_ints */
+#define OJSIM_FIELD_X 0                 /* Relative to the parent, world for roots */
+#define OJSIM_FIELD_Y 1
+#define OJSIM_FIELD_ANGLE 2
+#define OJSIM_FIELD_VEL_X 3             /* Only meaningful on roots */
+#define OJSIM_FIELD_VEL_Y 4
+#define OJSIM_FIELD_ANGLE_VEL 5
+#define OJSIM_FIELD_LIQUID_FUEL 6
+#define OJSIM_FIELD_SOLID_FUEL 7
+#define OJSIM_FIELD_WORLD_X 8
+#define OJSIM_FIELD_WORLD_Y 9
+#define OJSIM_FIELD_WORLD_ANGLE 10
+#define OJSIM_FLOAT_FIELD_COUNT 11
+
+#define OJSIM_FIELD_PARENT 0            /* -1 for roots */
+#define OJSIM_FIELD_PART_ID 1           /* Catalog id */
+#define OJSIM_FIELD_STAGE 2             /* -1 when not staged */
+#define OJSIM_FIELD_FLAGS 3
+#define OJSIM_INT_FIELD_COUNT 4
+
+/* Main vehicle state after one tick */
+typedef struct ojsim_telemetry
+{
+    float time;
+    float x, y;
+    float vx, vy;
+    float angle;
+    float angleVelocity;
+    float altitude;
+    float speed;
+    float mass;
+    float liquidFuel;
+    float solidFuel;
+    int stagesLeft;
+    int flags;
+} ojsim_telemetry;
+
+OJSIM_API int ojsim_get_api_version(void);
+
+/* Loads "ojam16 - parts.csv". Returns NULL if the file can't be read. */
+OJSIM_API ojsim_catalog* ojsim_catalog_load(const char* partsCsvPath);
+OJSIM_API void ojsim_catalog_free(ojsim_catalog* pCatalog);
+OJSIM_API int ojsim_catalog_get_part_count(const ojsim_catalog* pCatalog);
+
+/* The catalog must outlive the simulation. seed drives decoupling spin. */
+OJSIM_API ojsim_sim* ojsim_create(const ojsim_catalog* pCatalog, unsigned int seed);
+OJSIM_API void ojsim_destroy(ojsim_sim* pSim);
+
+/*
+ * Adds a part and returns its index, or -1 on bad input. The first part is
+ * the main vehicle's root and takes world coordinates, the game puts it at
+ * (0, -10000 - vehicle height). Parents must be added before their children.
+ * Stages fire from the highest number down to 0, like the editor's panel.
+ */
+OJSIM_API int ojsim_add_part(ojsim_sim* pSim, int partId, int parent, float x, float y, float angle, int stage);
+
+/* Fires the next stage, the first call also lifts off. Returns the stages left, -1 if there were none. */
+OJSIM_API int ojsim_activate_next_stage(ojsim_sim* pSim);
+
+/* Steers the main vehicle like the arrow keys do, direction is -1, 0 or 1 for the next ticks */
+OJSIM_API void ojsim_set_steering(ojsim_sim* pSim, int direction);
+
+/*
+ * Runs up to tickCount ticks of dt seconds. pTelemetry, if not NULL, receives
+ * one record per tick run, OJSIM_STABLE_ORBIT is only checked for the last
+ * one. Stops early once the main vehicle is destroyed. Returns the number of
+ * ticks run.
+ */
+OJSIM_API int ojsim_step(ojsim_sim* pSim, int tickCount, float dt, ojsim_telemetry* pTelemetry);
+
+/* The main vehicle's current state, OJSIM_STABLE_ORBIT included. For callers that step without telemetry. */
+OJSIM_API void ojsim_get_telemetry(ojsim_sim* pSim, ojsim_telemetry* pTelemetry);
+
+/*
+ * Zero-copy views of the per part state, ojsim_get_part_count entries long.
+ * They stay valid until the next ojsim_add_part or ojsim_destroy.
+ */
+OJSIM_API int ojsim_get_part_count(const ojsim_sim* pSim);
+OJSIM_API const float* ojsim_get_part_floats(const ojsim_sim* pSim, int field);
+OJSIM_API const int* ojsim_get_part_ints(const ojsim_sim* pSim, int field);
+
+#ifdef __cplusplus
+}
+#endif
@@ -6,8 +6,14 @@
 #include <onut/Random.h>
 #include <onut/Sound.h>
 
+#include "culling.h"
+#include "design.h"
+#include "emitters.h"
 #include "part.h"
 #include "particle.h"
+#include "physics.h"
+#include "terrain.h"
+#include "vehiclemesh.h"
 #include "defines.h"
 
 std::vector<PartDef> partDefs;
@@ -17,10 +23,6 @@ std::vector<std::vector<Part*>> stages;
 
 OTextureRef pEngineCoverTexture;
 OTextureRef pEngineCoverWideTexture;
-OTextureRef pFireTexture;
-OTextureRef pBlueFireTexture;
-OTextureRef pDebrisTexture;
-OTextureRef pSmokeTexture;
 float shakeAmount = 0;
 float globalStability = 0;
 
@@ -47,10 +49,6 @@ void initPartDefs()
 {
     pEngineCoverTexture = OGetTexture("PART_ENGINE_COVER.png");
     pEngineCoverWideTexture = OGetTexture("PART_ENGINE_COVER_WIDE.png");
-    pFireTexture = OGetTexture("PARTICLE_FIRE.png");
-    pSmokeTexture = OGetTexture("PARTICLE_SMOKE.png");
-    pBlueFireTexture = OGetTexture("PARTICLE_BLUE_FLAME.png");
-    pDebrisTexture = OGetTexture("PARTICLE_DEBRIS.png");
 
     auto pPartsCSV = OGetCSV("ojam16 - parts.csv");
     auto pAttachPointsCSV = OGetCSV("ojam16 - attachPoints.csv");
@@ -129,6 +127,8 @@ void deletePart(Part* in_pPart)
 {
     if (!in_pPart) return;
     if (pMainPart == in_pPart) pMainPart = nullptr;
+    detachEmitters(in_pPart);
+    invalidateVehicleMesh(in_pPart);
     if (in_pPart->pParent)
     {
         detachFromParent(in_pPart);
@@ -170,31 +170,14 @@ void deleteParts(Parts& parts)
     }
 }
 
-struct OnTopSprite
-{
-    OTextureRef pTexture;
-    Matrix transform;
-};
-
 extern Part* pHoverPart;
 
-using OnTopSprites = std::vector<OnTopSprite>;
-OnTopSprites onTopSprites;
-OnTopSprite hoverSprite;
-
 void drawOnTops()
 {
-    for (auto& onTopSprite : onTopSprites)
-    {
-        oSpriteBatch->drawSprite(onTopSprite.pTexture,
-                                 onTopSprite.transform,
-                                 Color::White);
-    }
-    onTopSprites.clear();
     if (pHoverPart)
     {
-        oSpriteBatch->drawSprite(hoverSprite.pTexture,
-                                 hoverSprite.transform,
+        oSpriteBatch->drawSprite(partDefs[pHoverPart->type].pTexture,
+                                 Matrix::CreateScale(1.0f / 64.0f) * getWorldTransform(pHoverPart),
                                  Color(1.5f, .75f, 1.5f, 1));
     }
 }
@@ -205,36 +188,23 @@ Part* getTopParent(Part* pPart)
     return getTopParent(pPart->pParent);
 }
 
-void drawParts(const Matrix& parentTransform, Parts& parts, Part* pParent)
+// One baked mesh per vehicle, see vehiclemesh.h. With a cull rect, in world
+// units, vehicles whose bounding circle misses it are skipped.
+void drawParts(const Matrix& parentTransform, Parts& parts, const Rect* pCullRect)
 {
     for (auto pPart : parts)
     {
-        auto& partDef = partDefs[pPart->type];
-        Matrix transform = Matrix::CreateRotationZ(pPart->angle) * Matrix::CreateTranslation(pPart->position) * parentTransform;
-        if (pPart == pHoverPart)
-        {
-            hoverSprite = {partDef.pTexture, Matrix::CreateScale(1.0f / 64.0f) * transform};
-        }
-        if (partDef.type == PART_TYPE_DECOUPLER)
+        auto transform = Matrix::CreateRotationZ(pPart->angle) * Matrix::CreateTranslation(pPart->position) * parentTransform;
+        if (pCullRect)
         {
-            if (pParent)
+            if (!isCircleInRect(*pCullRect, Vector2(transform.Translation()), getVehicleMeshRadius(pPart)))
             {
-                auto& parentPartDef = partDefs[pParent->type];
-                if (parentPartDef.type == PART_TYPE_BOOSTER ||
-                    parentPartDef.type == PART_TYPE_ENGINE)
-                {
-                    onTopSprites.push_back({partDef.pEngineCoverTexture, Matrix::CreateScale(1.0f / 64.0f) * Matrix::CreateTranslation(0, -.35f, 0) * transform});
-                }
+                ++cullStats.vehiclesCulled;
+                continue;
             }
-            onTopSprites.push_back({partDef.pTexture, Matrix::CreateScale(1.0f / 64.0f) * transform});
+            ++cullStats.vehiclesDrawn;
         }
-        else
-        {
-            oSpriteBatch->drawSprite(partDef.pTexture,
-                                     Matrix::CreateScale(1.0f / 64.0f) * transform,
-                                     Color::White);
-        }
-        drawParts(transform, pPart->children, pPart);
+        drawVehicleMesh(pPart, transform);
     }
 }
 
@@ -249,8 +219,8 @@ void drawAnchors(const Matrix& parentTransform, Parts& parts)
         {
             oSpriteBatch->drawCross(attachPoint, .2f, Color(0, 1, 1), .05f);
         }
-        drawParts(transform, pPart->children);
         oSpriteBatch->end();
+        drawAnchors(transform, pPart->children);
     }
 }
 
@@ -296,13 +266,7 @@ Part* mouseHoverPart(Part* pPart, const Vector2& mousePos, const Vector2& parent
     return nullptr;
 }
 
-struct Force
-{
-    Vector2 force;
-    Vector2 position;
-};
-using Forces = std::vector<Force>;
-Forces forces;
+std::vector<PhysicsForce> forces;
 
 Matrix getWorldTransform(Part* pPart)
 {
@@ -318,6 +282,12 @@ Matrix getWorldTransform(Part* pPart)
     return std::move(transform);
 }
 
+static float getWorldAngle(Part* pPart)
+{
+    if (!pPart->pParent) return pPart->angle;
+    return pPart->angle + getWorldAngle(pPart->pParent);
+}
+
 float getTotalMass(Part* pPart)
 {
     float ret = 0;
@@ -338,22 +308,15 @@ float getTotalStability(Part* pPart)
 
 Part* getLiquidFuel(Part* pPart, float& totalLeft, float& maxLiquidFuel)
 {
-    totalLeft += pPart->liquidFuel;
-    maxLiquidFuel += partDefs[pPart->type].liquidFuel;
-    if (pPart->pParent)
-    {
-        auto& parentPartDef = partDefs[pPart->pParent->type];
-        if (parentPartDef.type != PART_TYPE_DECOUPLER)
+    return findLiquidFuelTank(pPart, (Part*)nullptr,
+        [](Part* pNode) { return pNode->pParent; },
+        [](Part* pNode) { return partDefs[pNode->type].type == PART_TYPE_DECOUPLER; },
+        [&](Part* pNode)
         {
-            auto pParentIsTank = getLiquidFuel(pPart->pParent, totalLeft, maxLiquidFuel);
-            if (pParentIsTank) return pParentIsTank;
-        }
-    }
-    if (pPart->liquidFuel > 0)
-    {
-        return pPart;
-    }
-    return nullptr;
+            totalLeft += pNode->liquidFuel;
+            maxLiquidFuel += partDefs[pNode->type].liquidFuel;
+            return pNode->liquidFuel;
+        });
 }
 
 Parts toKill;
@@ -368,35 +331,12 @@ void explodePart(Part* pPart)
     }
     toKill.push_back(pPart);
     auto worldPos = Vector2(altT.Translation());
-    for (auto i = 0; i < 20; ++i)
-    {
-        spawnParticles({
-            worldPos + ORandVector2(Vector2(-1), Vector2(1)),
-            Vector2::Zero,
-            0,
-            1.0f,
-            Color(1, 1, 1, .5f), Color(0, 0, 0, 0),
-            0, 6.0f,
-            0,
-            180.0f,
-            pFireTexture
-        }, 1, 0.0f, 360.0f, 0, 45.0f, Vector2::UnitY);
-        spawnParticles({
-            worldPos,
-            ORandVector2(Vector2(-10), Vector2(10)),
-            0,
-            1.0f,
-            Color(1, 1, 1, 1), Color(1, 1, 1, 1),
-            .5f, .5f,
-            0,
-            180.0f,
-            pDebrisTexture
-        }, 1, 0, 360.0f, 2.0f, 45.0f, Vector2::UnitY);
-    }
+    static int explosionFire = getEmitterDef("explosionFire");
+    static int explosionDebris = getEmitterDef("explosionDebris");
+    burstEmitter(explosionFire, worldPos, Vector2::UnitX, Vector2::UnitY, Vector2::Zero);
+    burstEmitter(explosionDebris, worldPos, Vector2::UnitX, Vector2::UnitY, Vector2::Zero);
 }
 
-int spawn = 0;
-
 void updatePart(Part* pPart)
 {
     auto& partDef = partDefs[pPart->type];
@@ -425,74 +365,32 @@ void updatePart(Part* pPart)
     }
 
     extern int gameState;
-    if (gameState == GAME_STATE_STAND_BY &&
-        partDef.type == PART_TYPE_BOOSTER &&
-        spawn % 4 == 0)
-    {
-        auto transform = getWorldTransform(pPart);
-        auto worldPos = transform.Translation();
-        worldPos.x -= .15f;
-        spawnParticles({
-            worldPos,
-            Vector2(0, .5f),
-            0,
-            2,
-            Color(1, 1, 1, 1), Color(0, 0, 0, 0),
-            .25f, .5f,
-            ORandFloat(0, 360),
-            30.0f,
-            pSmokeTexture
-        }, 1, 0, 0, 0, 0, Vector2(0, 1));
-    }
+    pPart->isBurning = false;
 
     if (pPart->isActive)
     {
+        float* pFuel = nullptr;
         switch (partDef.type)
         {
             case PART_TYPE_BOOSTER:
-            {
-                if (pPart->solidFuel > 0)
-                {
-                    shakeAmount += 1;
-                    pPart->solidFuel -= partDef.burn * ODT;
-                    auto transform = getWorldTransform(pPart);
-                    auto worldPos = transform.Translation();
-                    auto forward = transform.Up();
-                    forward *= -1;
-                    forward.Normalize();
-                    worldPos -= forward * .75f;
-                    forces.push_back({forward * partDef.trust, worldPos});
-                    if (pPart->solidFuel <= 0.0f)
-                    {
-                        pPart->solidFuel = 0;
-                    }
-                }
+                pFuel = &pPart->solidFuel;
                 break;
-            }
             case PART_TYPE_ENGINE:
             {
                 float amount = 0;
                 float maxLiquidFuel = 0;
                 auto pTank = getLiquidFuel(pPart, amount, maxLiquidFuel);
-                if (pTank && pTank->liquidFuel > 0)
-                {
-                    shakeAmount += 1;
-                    pTank->liquidFuel -= partDef.burn * ODT;
-                    auto transform = getWorldTransform(pPart);
-                    auto worldPos = transform.Translation();
-                    auto forward = transform.Up();
-                    forward *= -1;
-                    forward.Normalize();
-                    worldPos -= forward * .75f;
-                    forces.push_back({forward * partDef.trust, worldPos});
-                    if (pTank->liquidFuel <= 0.0f)
-                    {
-                        pTank->liquidFuel = 0;
-                    }
-                }
+                if (pTank) pFuel = &pTank->liquidFuel;
                 break;
             }
         }
+        if (pFuel && burnFuel(*pFuel, partDef.burn, ODT))
+        {
+            shakeAmount += 1;
+            pPart->isBurning = true;
+            auto worldPos = getWorldTransform(pPart).Translation();
+            forces.push_back(getThrust(worldPos.x, worldPos.y, getWorldAngle(pPart), partDef.trust));
+        }
     }
 
     for (auto pChild : pPart->children)
@@ -503,196 +401,34 @@ void updatePart(Part* pPart)
     // Finalize update and physic of the main body
     if (!pPart->pParent && gameState != GAME_STATE_STAND_BY)
     {
-        auto dirToPlanet = -pPart->position;
-        dirToPlanet.Normalize();
-
-        // Apply different forces
-        // f = ma
-        // a = f / m
         pTopParent->centerOfMass /= pTopParent->totalMass;
-        auto transformMe = getWorldTransform(pPart);
-        auto worldCenterOfMass = Vector2::Transform(pTopParent->centerOfMass, transformMe);
-        auto right = Vector2(transformMe.Right());
-        right.Normalize();
-        for (int i = 0; i < (int)forces.size(); ++i)
+        RigidBody body = {pPart->position.x, pPart->position.y, pPart->angle, pPart->vel.x, pPart->vel.y, pPart->angleVelocity};
+        float deltaV = 0;
+        for (auto& force : forces)
         {
-            auto& force = forces[i];
-            Vector2 dirToCenterOfMass = force.position - worldCenterOfMass;
-            dirToCenterOfMass.Normalize();
-            auto forceDir = force.force;
-            forceDir.Normalize();
-            float directEffect = std::fabsf(dirToCenterOfMass.y);
-            float angularEffect = dirToCenterOfMass.Dot(right);
-            pPart->vel += Vector2(force.force / pTopParent->totalMass) * ODT;
-            pPart->angleVelocity -= (angularEffect / pTopParent->totalMass * 100) * ODT;
+            deltaV += applyForce(body, pTopParent->centerOfMass.x, pTopParent->centerOfMass.y, pTopParent->totalMass, force, ODT);
         }
-
-        float turbulence = 50.0f / std::max(1.0f, (pPart->position.Length() - PLANET_SIZE));
-        turbulence *= pPart->vel.Length();
-        turbulence = OLerp(turbulence, 0.0f, std::max(0.0f, std::min(1.0f, (pPart->position.Length() - PLANET_SIZE) / 2000)));
-        //pPart->angleVelocity += (ORandFloat(-turbulence, turbulence) / pTopParent->totalMass) * ODT;
-        pPart->angle += pPart->angleVelocity * ODT;
-        pPart->vel += dirToPlanet * GRAVITY * ODT;
-        pPart->position += pPart->vel * ODT;
-        if (pPart->angleVelocity > 0)
+        if (pMainPart && getTopParent(pMainPart) == pPart)
         {
-            pPart->angleVelocity -= globalStability / pTopParent->totalMass * 4 * ODT;
-            if (pPart->angleVelocity < 0)
-            {
-                pPart->angleVelocity = 0;
-            }
-        }
-        else if (pPart->angleVelocity < 0)
-        {
-            pPart->angleVelocity += globalStability / pTopParent->totalMass * 4 * ODT;
-            if (pPart->angleVelocity > 0)
-            {
-                pPart->angleVelocity = 0;
-            }
+            updateFlightRecord(deltaV);
         }
+        integrateBody(body, pTopParent->totalMass, globalStability, ODT);
+        pPart->position = Vector2(body.x, body.y);
+        pPart->angle = body.angle;
+        pPart->vel = Vector2(body.vx, body.vy);
+        pPart->angleVelocity = body.angleVelocity;
         pPart->speed = pPart->vel.Length();
         pPart->altitude = pPart->position.Length() - PLANET_SIZE;
     }
 
-    if (pPart->isActive)
+    if (partDef.type == PART_TYPE_ENGINE && !pPart->isBurning && pPart->pSound)
     {
-        switch (partDef.type)
-        {
-            case PART_TYPE_BOOSTER:
-            {
-                if (pPart->solidFuel > 0)
-                {
-                    auto transform = getWorldTransform(pPart);
-                    auto worldPos = transform.Translation();
-                    auto forward = transform.Up();
-                    forward *= -1;
-                    forward.Normalize();
-                    worldPos -= forward * .75f;
-                    spawnParticles({
-                        worldPos,
-                        pPart->vel - Vector2(forward * 10.0f),
-                        0,
-                        .25f,
-                        Color(1, 1, .5f, .75f), Color(0, 0, 0, 0),
-                        .5f, 2.0f,
-                        2.0f,
-                        45.0f,
-                        pFireTexture
-                    }, 2, 10.0f, 360.0f, 0, 0, -forward);
-                    spawnParticles({
-                        worldPos,
-                        Vector2::Zero,
-                        0,
-                        1,
-                        Color(1, 1, 1, 1), Color(0, 0, 0, 0),
-                        .5f, 10.0f,
-                        2.0f,
-                        5.0f,
-                        pSmokeTexture
-                    }, 1, 0, 360.0f, 0, 0, -forward);
-                }
-                break;
-            }
-            case PART_TYPE_ENGINE:
-            {
-                float amount = 0, maxLiquidFuel = 0;
-                auto pTank = getLiquidFuel(pPart, amount, maxLiquidFuel);
-                if (partDef.burn > .5f && partDef.burn <= 1.5f)
-                {
-                    if (pTank && pTank->liquidFuel > 0)
-                    {
-                        auto transform = getWorldTransform(pPart);
-                        auto worldPos = transform.Translation();
-                        auto forward = transform.Up();
-                        auto right = transform.Right();
-                        forward *= -1;
-                        forward.Normalize();
-                        right.Normalize();
-                        worldPos -= forward * .25f;
-                        spawnParticles({
-                            worldPos,
-                            pPart->vel - Vector2(forward * 10.0f),
-                            0,
-                            .25f,
-                            Color(1, 1, 1, 1), Color(0, 0, 0, 0),
-                            .5f, 2.0f,
-                            2.0f,
-                            45.0f,
-                            pBlueFireTexture
-                        }, 1, 10.0f, 360.0f, 0, 0, -forward);
-                    }
-                    else
-                    {
-                        if (pPart->pSound)
-                        {
-                            pPart->pSound->stop();
-                            pPart->pSound = nullptr;
-                        }
-                    }
-                }
-                else if (partDef.burn > 2.5f && partDef.burn <= 3.5f)
-                {
-                    if (pTank && pTank->liquidFuel > 0)
-                    {
-                        auto transform = getWorldTransform(pPart);
-                        auto worldPos = transform.Translation();
-                        auto forward = transform.Up();
-                        auto right = transform.Right();
-                        forward *= -1;
-                        forward.Normalize();
-                        right.Normalize();
-                        worldPos -= forward * .25f;
-                        spawnParticles({
-                            worldPos + right * .5f,
-                            pPart->vel - Vector2(forward * 10.0f),
-                            0,
-                            .25f,
-                            Color(1, 1, 1, 1), Color(0, 0, 0, 0),
-                            .5f, 2.0f,
-                            2.0f,
-                            45.0f,
-                            pBlueFireTexture
-                        }, 1, 10.0f, 360.0f, 0, 0, -forward);
-                        spawnParticles({
-                            worldPos - right * .5f,
-                            pPart->vel - Vector2(forward * 10.0f),
-                            0,
-                            .25f,
-                            Color(1, 1, 1, 1), Color(0, 0, 0, 0),
-                            .5f, 2.0f,
-                            2.0f,
-                            45.0f,
-                            pBlueFireTexture
-                        }, 1, 10.0f, 360.0f, 0, 0, -forward);
-                        spawnParticles({
-                            worldPos,
-                            pPart->vel - Vector2(forward * 10.0f),
-                            0,
-                            .25f,
-                            Color(1, 1, 1, 1), Color(0, 0, 0, 0),
-                            .5f, 2.0f,
-                            2.0f,
-                            45.0f,
-                            pBlueFireTexture
-                        }, 1, 10.0f, 360.0f, 0, 0, -forward);
-                    }
-                    else
-                    {
-                        if (pPart->pSound)
-                        {
-                            pPart->pSound->stop();
-                            pPart->pSound = nullptr;
-                        }
-                    }
-                }
-                break;
-            }
-        }
+        pPart->pSound->stop();
+        pPart->pSound = nullptr;
     }
 
-    auto altT = getWorldTransform(pPart);
-    auto altitude = Vector2(altT.Translation()).Length();
-    if (altitude < PLANET_SIZE)
+    auto worldPos = getWorldTransform(pPart).Translation();
+    if (isUnderground(worldPos.x, worldPos.y))
     {
         explodePart(pPart);
     }
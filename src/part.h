@@ -39,9 +39,12 @@ struct Part
     Parts children;
     bool fixed = false;
     bool isActive = false;
+    bool isBurning = false; // Thrusting this tick
     std::set<int> usedAttachPoints;
     Part* pParent = nullptr;
     float totalMass = 0;
+    float subtreeDryMass = 0; // Maintained by the editor, see analysis.h
+    float subtreeFuel = 0;
     Vector2 centerOfMass;
     float speed = 0;
     float altitude = 0;
@@ -71,7 +74,7 @@ extern Parts toKill;
 
 void deleteParts(Parts& parts);
 void initPartDefs();
-void drawParts(const Matrix& parentTransform, Parts& parts, Part* pParent = nullptr);
+void drawParts(const Matrix& parentTransform, Parts& parts, const Rect* pCullRect = nullptr);
 void drawAnchors(const Matrix& parentTransform, Parts& parts);
 void drawOnTops();
 Rect vehiculeRect(Part* pPart, const Vector2& parentPos = Vector2::Zero);
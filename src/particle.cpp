@@ -1,23 +1,210 @@
 #include <onut/Curve.h>
+#include <onut/IndexBuffer.h>
+#include <onut/Renderer.h>
 #include <onut/Timing.h>
-#include <onut/SpriteBatch.h>
-#include <onut/Random.h>
 #include <onut/Texture.h>
+#include <onut/VertexBuffer.h>
+#include <algorithm>
+#include <cstring>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define PARTICLE_SSE2
+#endif
+
+#include "culling.h"
+#include "defines.h"
+#include "emitters.h"
+#include "jobs.h"
 #include "particle.h"
+#include "particlequads.h"
+#include "renderqueue.h"
+#include "rng.h"
+#include "terrain.h"
+
+#define ANGLE_UNITS_PER_DEGREE (65536.0f / 360.0f)
+#define ANGLE_VEL_UNITS_PER_DEGREE 64.0f
+#define SPAWN_BATCH 64
+#define PARTICLE_BOUNCE_RESTITUTION .4f
+#define PARTICLE_BOUNCE_FRICTION .8f
+#define PARTICLE_SETTLE_FRICTION .5f
+#define PARTICLE_CHUNK_SIZE 8192
+#define MAX_PARTICLE_CHUNKS (MAX_PARTICLES / PARTICLE_CHUNK_SIZE)
+#define MAX_PARTICLE_QUADS PARTICLE_BUDGET // Emitters never go past it, anything more isn't drawn
+#define PARTICLE_NEAR_GROUND_SQ ((PLANET_SIZE + TERRAIN_MAX_HEIGHT) * (PLANET_SIZE + TERRAIN_MAX_HEIGHT))
+
+ParticlePool particles;
+std::vector<ParticleClass> particleClasses;
+std::vector<OTextureRef> particleTextures;
+static uint8_t sourceCollisions[MAX_PARTICLE_SOURCES + 1];
+
+// Chunk boundaries only depend on the particle count, never on the thread
+// count, so the result is the same on any machine
+static ParticlePool compactScratch;
+static int chunkAlive[MAX_PARTICLE_CHUNKS];
+static int chunkDeaths[MAX_PARTICLE_CHUNKS][MAX_PARTICLE_SOURCES + 1];
+static int chunkQuadCounts[MAX_PARTICLE_CHUNKS][PARTICLE_QUAD_MAX_TEXTURES];
+static int chunkCulled[MAX_PARTICLE_CHUNKS];
+static uint8_t particleVisible[MAX_PARTICLES];
+
+static_assert(MAX_PARTICLE_TEXTURES <= PARTICLE_QUAD_MAX_TEXTURES, "Quad batches can't hold every particle texture");
+
+// Quads are rebuilt every frame into one dynamic buffer, indices never change
+PARTICLE_QUAD_ALIGN static ParticleQuadVertex quadVertices[MAX_PARTICLE_QUADS * 4];
+static ParticleQuadClass quadClasses[MAX_PARTICLE_CLASSES];
+static int quadClassCount = 0;
+static int fallbackCount = 0;
+static float maxQuadExtent = 0; // Farthest a quad corner gets from its particle
+static OVertexBufferRef pQuadVB;
+static OIndexBufferRef pQuadIB;
+
+static int findTextureSlot(const OTextureRef& pTexture)
+{
+    for (int i = 0; i < (int)particleTextures.size(); ++i)
+    {
+        if (particleTextures[i] == pTexture) return i;
+    }
+    return -1;
+}
+
+// Out of classes or texture slots. A class with the same texture stands in,
+// or the first one, so the effect looks off but nothing overflows. Counted
+// for the HUD.
+static int getFallbackParticleClass(const OTextureRef& pTexture)
+{
+    ++fallbackCount;
+    int textureSlot = findTextureSlot(pTexture);
+    for (int i = 0; i < (int)particleClasses.size(); ++i)
+    {
+        if (particleClasses[i].textureSlot == textureSlot) return i;
+    }
+    return 0;
+}
+
+// Templates are mostly literals in a handful of places, so there are only
+// a few classes and the last one found is usually the next one asked for.
+static int getParticleClass(const Particle& templateParticle)
+{
+    static int lastFound = 0;
+    auto matches = [&](const ParticleClass& particleClass)
+    {
+        return particleClass.colorFrom == templateParticle.colorFrom &&
+               particleClass.colorTo == templateParticle.colorTo &&
+               particleClass.sizeFrom == templateParticle.sizeFrom &&
+               particleClass.sizeTo == templateParticle.sizeTo &&
+               particleClass.duration == templateParticle.duration &&
+               particleTextures[particleClass.textureSlot] == templateParticle.pTexture;
+    };
+    if (lastFound < (int)particleClasses.size() && matches(particleClasses[lastFound])) return lastFound;
+    for (int i = 0; i < (int)particleClasses.size(); ++i)
+    {
+        if (matches(particleClasses[i])) return lastFound = i;
+    }
+
+    int textureSlot = findTextureSlot(templateParticle.pTexture);
+    if (particleClasses.size() >= MAX_PARTICLE_CLASSES ||
+        (textureSlot == -1 && particleTextures.size() >= MAX_PARTICLE_TEXTURES))
+    {
+        return lastFound = getFallbackParticleClass(templateParticle.pTexture);
+    }
+    if (textureSlot == -1)
+    {
+        textureSlot = (int)particleTextures.size();
+        particleTextures.push_back(templateParticle.pTexture);
+    }
+
+    ParticleClass particleClass;
+    particleClass.colorFrom = templateParticle.colorFrom;
+    particleClass.colorTo = templateParticle.colorTo;
+    particleClass.sizeFrom = templateParticle.sizeFrom;
+    particleClass.sizeTo = templateParticle.sizeTo;
+    particleClass.duration = templateParticle.duration;
+    particleClass.textureScale = 1.0f / templateParticle.pTexture->getSizef().x;
+    particleClass.textureSlot = (uint8_t)textureSlot;
+    particleClasses.push_back(particleClass);
+    return lastFound = (int)particleClasses.size() - 1;
+}
+
+static void addParticle(int particleClass, int source, const Vector2& position, const Vector2& vel, float life, float angle, float angleVel)
+{
+    if (particles.count >= MAX_PARTICLES) return;
+    int i = particles.count++;
+    particles.positionX[i] = position.x;
+    particles.positionY[i] = position.y;
+    particles.velX[i] = vel.x;
+    particles.velY[i] = vel.y;
+    particles.life[i] = life;
+    particles.lifeRate[i] = 1.0f / particleClasses[particleClass].duration;
+    particles.angle[i] = (uint16_t)(int)(angle * ANGLE_UNITS_PER_DEGREE);
+    particles.angleVel[i] = (int16_t)std::max(-32768.0f, std::min(32767.0f, angleVel * ANGLE_VEL_UNITS_PER_DEGREE));
+    particles.particleClass[i] = (uint16_t)particleClass;
+    particles.source[i] = (uint16_t)source;
+    ++particles.sourceCounts[source];
+}
+
+void addParticle(const Particle& particle, int source)
+{
+    if (source < 0 || source > PARTICLE_NO_SOURCE) source = PARTICLE_NO_SOURCE;
+    addParticle(getParticleClass(particle), source, particle.position, particle.vel, particle.life, particle.angle, particle.angleVel);
+}
+
+Particle getParticle(int i)
+{
+    auto& particleClass = particleClasses[particles.particleClass[i]];
+    return {
+        Vector2(particles.positionX[i], particles.positionY[i]),
+        Vector2(particles.velX[i], particles.velY[i]),
+        particles.life[i],
+        particleClass.duration,
+        particleClass.colorFrom, particleClass.colorTo,
+        particleClass.sizeFrom, particleClass.sizeTo,
+        (float)particles.angle[i] / ANGLE_UNITS_PER_DEGREE,
+        (float)particles.angleVel[i] / ANGLE_VEL_UNITS_PER_DEGREE,
+        particleTextures[particleClass.textureSlot]
+    };
+}
+
+void clearParticles()
+{
+    particles.count = 0;
+    memset(particles.sourceCounts, 0, sizeof(particles.sourceCounts));
+}
+
+void setParticleSourceCollision(int source, int collision)
+{
+    if (source >= 0 && source < MAX_PARTICLE_SOURCES) sourceCollisions[source] = (uint8_t)collision;
+}
 
-Particles particles;
+int getFallbackParticleCount()
+{
+    return fallbackCount;
+}
 
-void spawnParticles(const Particle& templateParticle, int count, float spread, float angleRandom, float velRandom, float angleVelRandom, const Vector2& in_dir)
+void spawnParticles(const Particle& templateParticle, int count, float spread, float angleRandom, float velRandom, float angleVelRandom, const Vector2& in_dir, int source)
 {
+    int particleClass = getParticleClass(templateParticle);
     auto dir = in_dir;
     dir.Normalize();
+
+    // Draw all the random numbers up front, in batches
+    float spreads[SPAWN_BATCH];
+    float angles[SPAWN_BATCH];
+    float angleVels[SPAWN_BATCH];
     for (int i = 0; i < count; ++i)
     {
+        int b = i % SPAWN_BATCH;
+        if (b == 0)
+        {
+            int batchSize = std::min(count - i, SPAWN_BATCH);
+            fillRandomFloats(RANDOM_STREAM_EFFECTS, spreads, batchSize, -spread, spread);
+            fillRandomFloats(RANDOM_STREAM_EFFECTS, angles, batchSize, -angleRandom, angleRandom);
+            fillRandomFloats(RANDOM_STREAM_EFFECTS, angleVels, batchSize, -angleVelRandom, angleVelRandom);
+        }
         auto velSize = dir.Length();
         if (velSize > 0.0f)
         {
             float startAngle = std::atan2f(dir.y, dir.x);
-            startAngle += DirectX::XMConvertToRadians(ORandFloat(-spread, spread));
+            startAngle += DirectX::XMConvertToRadians(spreads[b]);
             auto velDir = templateParticle.vel;
             velDir.Normalize();
             auto dot = velDir.Dot(dir);
@@ -25,45 +212,322 @@ void spawnParticles(const Particle& templateParticle, int count, float spread, f
             dir.x = std::cosf(startAngle) * velSize * dot;
             dir.y = std::sinf(startAngle) * velSize * dot;
         }
-        particles.push_back({
-            templateParticle.position,
-            templateParticle.vel + dir,
-            0,
-            templateParticle.duration,
-            templateParticle.colorFrom, templateParticle.colorTo,
-            templateParticle.sizeFrom, templateParticle.sizeTo,
-            templateParticle.angle + ORandFloat(-angleRandom, angleRandom),
-            templateParticle.angleVel + ORandFloat(-angleVelRandom, angleVelRandom),
-            templateParticle.pTexture
-        });
+        addParticle(particleClass,
+                    source,
+                    templateParticle.position,
+                    templateParticle.vel + dir,
+                    0,
+                    templateParticle.angle + angles[b],
+                    templateParticle.angleVel + angleVels[b]);
+    }
+}
+
+static void moveParticle(int from, int to)
+{
+    particles.positionX[to] = particles.positionX[from];
+    particles.positionY[to] = particles.positionY[from];
+    particles.velX[to] = particles.velX[from];
+    particles.velY[to] = particles.velY[from];
+    particles.life[to] = particles.life[from];
+    particles.lifeRate[to] = particles.lifeRate[from];
+    particles.angle[to] = particles.angle[from];
+    particles.angleVel[to] = particles.angleVel[from];
+    particles.particleClass[to] = particles.particleClass[from];
+    particles.source[to] = particles.source[from];
+}
+
+static void copyParticles(ParticlePool& to, int toIndex, const ParticlePool& from, int fromIndex, int count)
+{
+    memcpy(to.positionX + toIndex, from.positionX + fromIndex, count * sizeof(float));
+    memcpy(to.positionY + toIndex, from.positionY + fromIndex, count * sizeof(float));
+    memcpy(to.velX + toIndex, from.velX + fromIndex, count * sizeof(float));
+    memcpy(to.velY + toIndex, from.velY + fromIndex, count * sizeof(float));
+    memcpy(to.life + toIndex, from.life + fromIndex, count * sizeof(float));
+    memcpy(to.lifeRate + toIndex, from.lifeRate + fromIndex, count * sizeof(float));
+    memcpy(to.angle + toIndex, from.angle + fromIndex, count * sizeof(uint16_t));
+    memcpy(to.angleVel + toIndex, from.angleVel + fromIndex, count * sizeof(int16_t));
+    memcpy(to.particleClass + toIndex, from.particleClass + fromIndex, count * sizeof(uint16_t));
+    memcpy(to.source + toIndex, from.source + fromIndex, count * sizeof(uint16_t));
+}
+
+// Exact terrain test and response, only for the few particles near the ground
+static void collideParticle(int i)
+{
+    auto collision = sourceCollisions[particles.source[i]];
+    if (collision == PARTICLE_COLLISION_NONE) return;
+    Vector2 position(particles.positionX[i], particles.positionY[i]);
+    if (!isUnderground(position.x, position.y)) return;
+
+    auto up = position;
+    up.Normalize();
+    position = up * getSurfaceRadius(std::atan2f(position.y, position.x));
+    particles.positionX[i] = position.x;
+    particles.positionY[i] = position.y;
+
+    Vector2 normal;
+    getTerrainNormal(position.x, position.y, normal.x, normal.y);
+    Vector2 vel(particles.velX[i], particles.velY[i]);
+    float intoGround = vel.Dot(normal);
+    if (intoGround >= 0) return;
+    auto slide = vel - normal * intoGround;
+    if (collision == PARTICLE_COLLISION_BOUNCE)
+    {
+        vel = slide * PARTICLE_BOUNCE_FRICTION - normal * (intoGround * PARTICLE_BOUNCE_RESTITUTION);
+    }
+    else
+    {
+        vel = slide * PARTICLE_SETTLE_FRICTION;
+    }
+    particles.velX[i] = vel.x;
+    particles.velY[i] = vel.y;
+}
+
+// Everything above the highest peak is skipped with one radius test,
+// 4 particles at a time
+static void collideParticles(int first, int count)
+{
+    auto pX = particles.positionX + first;
+    auto pY = particles.positionY + first;
+    int i = 0;
+#if defined(PARTICLE_SSE2)
+    const __m128 nearGround = _mm_set1_ps(PARTICLE_NEAR_GROUND_SQ);
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 x = _mm_loadu_ps(pX + i);
+        __m128 y = _mm_loadu_ps(pY + i);
+        __m128 distSq = _mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y));
+        int mask = _mm_movemask_ps(_mm_cmplt_ps(distSq, nearGround));
+        if (!mask) continue;
+        for (int b = 0; b < 4; ++b)
+        {
+            if (mask & (1 << b)) collideParticle(first + i + b);
+        }
+    }
+#endif
+    for (; i < count; ++i)
+    {
+        if (pX[i] * pX[i] + pY[i] * pY[i] < PARTICLE_NEAR_GROUND_SQ) collideParticle(first + i);
     }
 }
 
+// Integrates one chunk and packs its live particles at the chunk's start,
+// in order
+static void updateParticleChunk(int chunk, float dt)
+{
+    int first = chunk * PARTICLE_CHUNK_SIZE;
+    int count = std::min(PARTICLE_CHUNK_SIZE, particles.count - first);
+
+    // Straight loops over plain arrays, no branches, so they vectorize
+    auto pLife = particles.life + first;
+    auto pLifeRate = particles.lifeRate + first;
+    auto pAngle = particles.angle + first;
+    auto pAngleVel = particles.angleVel + first;
+    auto pX = particles.positionX + first;
+    auto pY = particles.positionY + first;
+    auto pVelX = particles.velX + first;
+    auto pVelY = particles.velY + first;
+    float angleStep = ANGLE_UNITS_PER_DEGREE / ANGLE_VEL_UNITS_PER_DEGREE * dt;
+    for (int i = 0; i < count; ++i) pLife[i] += pLifeRate[i] * dt;
+    for (int i = 0; i < count; ++i) pAngle[i] += (uint16_t)(int)((float)pAngleVel[i] * angleStep);
+    for (int i = 0; i < count; ++i) pX[i] += pVelX[i] * dt;
+    for (int i = 0; i < count; ++i) pY[i] += pVelY[i] * dt;
+    collideParticles(first, count);
+
+    auto deaths = chunkDeaths[chunk];
+    memset(deaths, 0, sizeof(chunkDeaths[chunk]));
+    int alive = first;
+    for (int i = first; i < first + count; ++i)
+    {
+        if (particles.life[i] >= 1.0f)
+        {
+            ++deaths[particles.source[i]];
+            continue;
+        }
+        if (alive != i) moveParticle(i, alive);
+        ++alive;
+    }
+    chunkAlive[chunk] = alive - first;
+}
+
 void updateParticles()
 {
     auto dt = ODT;
-    for (auto it = particles.begin(); it != particles.end();)
+    int chunkCount = (particles.count + PARTICLE_CHUNK_SIZE - 1) / PARTICLE_CHUNK_SIZE;
+    if (!chunkCount) return;
+    parallelFor(chunkCount, [dt](int chunk) { updateParticleChunk(chunk, dt); });
+
+    // Where each chunk's survivors end up
+    int chunkTargets[MAX_PARTICLE_CHUNKS];
+    int count = 0;
+    for (int chunk = 0; chunk < chunkCount; ++chunk)
+    {
+        chunkTargets[chunk] = count;
+        count += chunkAlive[chunk];
+        for (int source = 0; source <= MAX_PARTICLE_SOURCES; ++source)
+        {
+            particles.sourceCounts[source] -= chunkDeaths[chunk][source];
+        }
+    }
+
+    // A chunk can land on survivors of the one before it that haven't moved
+    // yet, so the chunks that move go through the scratch pool
+    parallelFor(chunkCount, [&](int chunk)
+    {
+        int first = chunk * PARTICLE_CHUNK_SIZE;
+        if (chunkTargets[chunk] == first || !chunkAlive[chunk]) return;
+        copyParticles(compactScratch, chunkTargets[chunk], particles, first, chunkAlive[chunk]);
+    });
+    parallelFor(chunkCount, [&](int chunk)
+    {
+        int first = chunk * PARTICLE_CHUNK_SIZE;
+        if (chunkTargets[chunk] == first || !chunkAlive[chunk]) return;
+        copyParticles(particles, chunkTargets[chunk], compactScratch, chunkTargets[chunk], chunkAlive[chunk]);
+    });
+    particles.count = count;
+}
+
+// Classes only ever get added, convert the new ones
+static void updateQuadClasses()
+{
+    for (; quadClassCount < (int)particleClasses.size(); ++quadClassCount)
+    {
+        auto& particleClass = particleClasses[quadClassCount];
+        auto& quadClass = quadClasses[quadClassCount];
+        auto colorDelta = particleClass.colorTo - particleClass.colorFrom;
+        memcpy(quadClass.colorFrom, &particleClass.colorFrom, sizeof(quadClass.colorFrom));
+        memcpy(quadClass.colorDelta, &colorDelta, sizeof(quadClass.colorDelta));
+
+        // drawSprite scale is relative to the texture, so the width is size
+        auto& pTexture = particleTextures[particleClass.textureSlot];
+        auto textureSize = pTexture->getSizef();
+        quadClass.halfSizeFrom = particleClass.sizeFrom * particleClass.textureScale * textureSize.x * .5f;
+        quadClass.halfSizeDelta = (particleClass.sizeTo - particleClass.sizeFrom) * particleClass.textureScale * textureSize.x * .5f;
+        quadClass.aspect = textureSize.y / textureSize.x;
+        quadClass.textureSlot = particleClass.textureSlot;
+
+        auto halfSize = std::max(std::fabsf(quadClass.halfSizeFrom), std::fabsf(quadClass.halfSizeFrom + quadClass.halfSizeDelta));
+        maxQuadExtent = std::max(maxQuadExtent, halfSize * std::sqrtf(1 + quadClass.aspect * quadClass.aspect));
+    }
+}
+
+// Tests every particle of a chunk against the camera, then counts the quads
+// of the visible ones. Trails are spread over a long way and their particles
+// over the whole pool, so nothing coarser than a particle culls much.
+static void countVisibleParticleQuads(const ParticleQuadInput& input, int chunk, const Rect& cullRect)
+{
+    memset(chunkQuadCounts[chunk], 0, sizeof(chunkQuadCounts[chunk]));
+    int first = chunk * PARTICLE_CHUNK_SIZE;
+    int count = std::min(PARTICLE_CHUNK_SIZE, particles.count - first);
+    auto pX = particles.positionX + first;
+    auto pY = particles.positionY + first;
+    auto pVisible = particleVisible + first;
+    float left = cullRect.x - maxQuadExtent;
+    float top = cullRect.y - maxQuadExtent;
+    float right = cullRect.x + cullRect.z + maxQuadExtent;
+    float bottom = cullRect.y + cullRect.w + maxQuadExtent;
+
+    // No branches so it vectorizes
+    int visibleCount = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        pVisible[i] = (uint8_t)((pX[i] >= left) & (pX[i] <= right) & (pY[i] >= top) & (pY[i] <= bottom));
+        visibleCount += pVisible[i];
+    }
+    chunkCulled[chunk] = count - visibleCount;
+    countParticleQuads(input, first, count, chunkQuadCounts[chunk]);
+}
+
+// Past MAX_PARTICLE_QUADS, the last visible particles are dropped like culled ones
+static void limitParticleQuads(const ParticleQuadInput& input, int chunkCount)
+{
+    int quadCount = 0;
+    for (int chunk = 0; chunk < chunkCount; ++chunk)
     {
-        auto& particle = *it;
-        particle.life += (1.0f / particle.duration) * dt;
-        particle.angle += particle.angleVel * dt;
-        particle.position += particle.vel * dt;
-        if (particle.life >= 1.0f)
+        int first = chunk * PARTICLE_CHUNK_SIZE;
+        int count = std::min(PARTICLE_CHUNK_SIZE, particles.count - first);
+        if (quadCount + count - chunkCulled[chunk] <= MAX_PARTICLE_QUADS)
         {
-            it = particles.erase(it);
+            quadCount += count - chunkCulled[chunk];
             continue;
         }
-        ++it;
+        for (int i = first; i < first + count; ++i)
+        {
+            if (!particleVisible[i]) continue;
+            if (quadCount < MAX_PARTICLE_QUADS)
+            {
+                ++quadCount;
+                continue;
+            }
+            particleVisible[i] = 0;
+            --chunkQuadCounts[chunk][input.pClasses[input.particleClass[i]].textureSlot];
+            ++chunkCulled[chunk];
+        }
     }
 }
 
 void drawParticles()
 {
-    for (auto& particle : particles)
+    if (!particles.count) return;
+    if (!pQuadVB)
+    {
+        std::vector<uint32_t> indices(MAX_PARTICLE_QUADS * 6);
+        for (uint32_t i = 0; i < MAX_PARTICLE_QUADS; ++i)
+        {
+            auto pIndex = indices.data() + i * 6;
+            pIndex[0] = i * 4; pIndex[1] = i * 4 + 1; pIndex[2] = i * 4 + 2;
+            pIndex[3] = i * 4; pIndex[4] = i * 4 + 2; pIndex[5] = i * 4 + 3;
+        }
+        pQuadIB = OIndexBuffer::createStatic(indices.data(), (uint32_t)(indices.size() * sizeof(uint32_t)), 32);
+        pQuadVB = OVertexBuffer::createDynamic((uint32_t)sizeof(quadVertices));
+    }
+    updateQuadClasses();
+
+    ParticleQuadInput input = {
+        particles.count,
+        particles.positionX, particles.positionY,
+        particles.life, particles.angle, particles.particleClass,
+        quadClasses, particleVisible};
+    auto cullRect = getCameraRect();
+    int chunkCount = (particles.count + PARTICLE_CHUNK_SIZE - 1) / PARTICLE_CHUNK_SIZE;
+    parallelFor(chunkCount, [&](int chunk) { countVisibleParticleQuads(input, chunk, cullRect); });
+    if (particles.count > MAX_PARTICLE_QUADS) limitParticleQuads(input, chunkCount);
+
+    // Each chunk writes after the previous chunks' quads of the same texture,
+    // same order as a single pass
+    int quadCounts[PARTICLE_QUAD_MAX_TEXTURES] = {0};
+    int culled = 0;
+    for (int chunk = 0; chunk < chunkCount; ++chunk)
+    {
+        for (int slot = 0; slot < PARTICLE_QUAD_MAX_TEXTURES; ++slot) quadCounts[slot] += chunkQuadCounts[chunk][slot];
+        culled += chunkCulled[chunk];
+    }
+    int quadCount = particles.count - culled;
+    cullStats.particlesCulled += culled;
+    cullStats.particlesDrawn += quadCount;
+    if (!quadCount) return;
+    ParticleQuadBatch batches[PARTICLE_QUAD_MAX_TEXTURES];
+    int offsets[PARTICLE_QUAD_MAX_TEXTURES];
+    int batchCount = getParticleQuadBatches(quadCounts, offsets, batches);
+    for (int chunk = 0; chunk < chunkCount; ++chunk)
+    {
+        for (int slot = 0; slot < PARTICLE_QUAD_MAX_TEXTURES; ++slot)
+        {
+            int chunkCountForSlot = chunkQuadCounts[chunk][slot];
+            chunkQuadCounts[chunk][slot] = offsets[slot];
+            offsets[slot] += chunkCountForSlot;
+        }
+    }
+    parallelFor(chunkCount, [&](int chunk)
+    {
+        int first = chunk * PARTICLE_CHUNK_SIZE;
+        writeParticleQuads(input, first, std::min(PARTICLE_CHUNK_SIZE, particles.count - first), chunkQuadCounts[chunk], quadVertices);
+    });
+    pQuadVB->setData(quadVertices, (uint32_t)(quadCount * 4 * sizeof(ParticleQuadVertex)));
+
+    for (int i = 0; i < batchCount; ++i)
     {
-        auto color = OLerp(particle.colorFrom, particle.colorTo, particle.life);
-        auto size = OLerp(particle.sizeFrom, particle.sizeTo, particle.life);
-        size /= particle.pTexture->getSizef().x;
-        oSpriteBatch->drawSprite(particle.pTexture, particle.position, color, particle.angle, size);
+        auto& batch = batches[i];
+        queueDraw(RENDER_LAYER_PARTICLES, OBlendPreMultiplied, particleTextures[batch.textureSlot], pQuadVB, pQuadIB,
+                  Matrix::Identity, batch.firstQuad * 6, batch.quadCount * 6);
     }
 }
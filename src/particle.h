@@ -1,10 +1,22 @@
 #pragma once
 #include <onut/Maths.h>
+#include <cstdint>
 #include <vector>
 
 #include <onut/ForwardDeclaration.h>
 OForwardDeclare(Texture);
 
+#define MAX_PARTICLES 131072
+#define MAX_PARTICLE_CLASSES 256
+#define MAX_PARTICLE_TEXTURES 32
+#define MAX_PARTICLE_SOURCES 64
+#define PARTICLE_NO_SOURCE MAX_PARTICLE_SOURCES
+
+#define PARTICLE_COLLISION_NONE 0
+#define PARTICLE_COLLISION_BOUNCE 1
+#define PARTICLE_COLLISION_SETTLE 2
+
+// Spawn template, and what a single particle reads back as
 struct Particle
 {
     Vector2 position;
@@ -18,10 +30,47 @@ struct Particle
     OTextureRef pTexture;
 };
 
-void spawnParticles(const Particle& templateParticle, int count, float spread, float angleRandom, float velRandom, float angleVelRandom, const Vector2& in_dir);
+// What particles spawned from the same template share
+struct ParticleClass
+{
+    Color colorFrom, colorTo;
+    float sizeFrom, sizeTo;
+    float duration;
+    float textureScale; // 1 / texture width
+    uint8_t textureSlot;
+};
+
+// Live particles are packed in [0, count), removal moves the last one into
+// the hole. 32 bytes each, split per field so the update vectorizes.
+// Angles are in 1/65536 of a turn so they wrap on their own, angular
+// velocities in 1/64 degree per second.
+struct ParticlePool
+{
+    int count = 0;
+
+    float positionX[MAX_PARTICLES];
+    float positionY[MAX_PARTICLES];
+    float velX[MAX_PARTICLES];
+    float velY[MAX_PARTICLES];
+    float life[MAX_PARTICLES];
+    float lifeRate[MAX_PARTICLES]; // 1 / duration
+    uint16_t angle[MAX_PARTICLES];
+    int16_t angleVel[MAX_PARTICLES];
+    uint16_t particleClass[MAX_PARTICLES];
+    uint16_t source[MAX_PARTICLES]; // Emitter def that spawned it
+
+    int sourceCounts[MAX_PARTICLE_SOURCES + 1]; // Live particles per source
+};
+
+void spawnParticles(const Particle& templateParticle, int count, float spread, float angleRandom, float velRandom, float angleVelRandom, const Vector2& in_dir, int source = PARTICLE_NO_SOURCE);
+void addParticle(const Particle& particle, int source = PARTICLE_NO_SOURCE);
+Particle getParticle(int index);
+void clearParticles();
+void setParticleSourceCollision(int source, int collision);
+int getFallbackParticleCount(); // Spawns given a stand-in class because the class or texture limit was hit
 void updateParticles();
 void drawParticles();
 
-using Particles = std::vector<Particle>;
-
-extern Particles particles;
+extern ParticlePool particles;
+extern std::vector<ParticleClass> particleClasses;
+extern std::vector<OTextureRef> particleTextures;
@@ -0,0 +1,114 @@
+#include <cmath>
+
+// PARTICLE_QUADS_NO_SSE2 forces the scalar path, see tools/particlequads
+#if (defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)) && !defined(PARTICLE_QUADS_NO_SSE2)
+#include <emmintrin.h>
+#define PARTICLE_QUADS_SSE2
+#endif
+
+#include "particlequads.h"
+
+#define SIN_TABLE_BITS 12
+#define SIN_TABLE_SIZE (1 << SIN_TABLE_BITS)
+#define SIN_TABLE_SHIFT (16 - SIN_TABLE_BITS)
+
+// Particle angles are 16 bits, 4096 steps is well under a pixel at any size
+struct SinCosTable
+{
+    float sinCos[SIN_TABLE_SIZE][2];
+
+    SinCosTable()
+    {
+        for (int i = 0; i < SIN_TABLE_SIZE; ++i)
+        {
+            double angle = (double)i / (double)SIN_TABLE_SIZE * 6.283185307179586;
+            sinCos[i][0] = (float)std::sin(angle);
+            sinCos[i][1] = (float)std::cos(angle);
+        }
+    }
+};
+
+static const SinCosTable sinCosTable;
+
+void countParticleQuads(const ParticleQuadInput& input, int first, int count, int* pCounts)
+{
+    if (input.visible)
+    {
+        for (int i = first; i < first + count; ++i) pCounts[input.pClasses[input.particleClass[i]].textureSlot] += input.visible[i];
+        return;
+    }
+    for (int i = first; i < first + count; ++i) ++pCounts[input.pClasses[input.particleClass[i]].textureSlot];
+}
+
+int getParticleQuadBatches(const int* pCounts, int* pOffsets, ParticleQuadBatch* pBatches)
+{
+    int batchCount = 0;
+    int quadCount = 0;
+    for (int slot = 0; slot < PARTICLE_QUAD_MAX_TEXTURES; ++slot)
+    {
+        pOffsets[slot] = quadCount;
+        if (!pCounts[slot]) continue;
+        pBatches[batchCount++] = {slot, quadCount, pCounts[slot]};
+        quadCount += pCounts[slot];
+    }
+    return batchCount;
+}
+
+void writeParticleQuads(const ParticleQuadInput& input, int first, int count, int* pOffsets, ParticleQuadVertex* pVertices)
+{
+    for (int i = first; i < first + count; ++i)
+    {
+        if (input.visible && !input.visible[i]) continue;
+        auto& quadClass = input.pClasses[input.particleClass[i]];
+        auto pQuad = pVertices + 4 * pOffsets[quadClass.textureSlot]++;
+        float life = input.life[i];
+        auto& sinCos = sinCosTable.sinCos[input.angle[i] >> SIN_TABLE_SHIFT];
+        float halfWidth = quadClass.halfSizeFrom + quadClass.halfSizeDelta * life;
+        float halfHeight = halfWidth * quadClass.aspect;
+
+        // Corners are +-a +-b, a along the rotated width and b along the height
+        float ax = halfWidth * sinCos[1];
+        float ay = halfWidth * sinCos[0];
+        float bx = -halfHeight * sinCos[0];
+        float by = halfHeight * sinCos[1];
+
+#if defined(PARTICLE_QUADS_SSE2)
+        __m128 base = _mm_setr_ps(input.positionX[i], input.positionY[i], 0, 0);
+        __m128 sum = _mm_setr_ps(ax + bx, ay + by, 0, 0);
+        __m128 diff = _mm_setr_ps(ax - bx, ay - by, 0, 0);
+        __m128 color = _mm_add_ps(_mm_loadu_ps(quadClass.colorFrom),
+                                  _mm_mul_ps(_mm_loadu_ps(quadClass.colorDelta), _mm_set1_ps(life)));
+        auto pOut = reinterpret_cast<float*>(pQuad);
+        _mm_store_ps(pOut + 0, _mm_sub_ps(base, sum));
+        _mm_store_ps(pOut + 4, color);
+        _mm_store_ps(pOut + 8, _mm_add_ps(_mm_sub_ps(base, diff), _mm_setr_ps(0, 0, 0, 1)));
+        _mm_store_ps(pOut + 12, color);
+        _mm_store_ps(pOut + 16, _mm_add_ps(_mm_add_ps(base, sum), _mm_setr_ps(0, 0, 1, 1)));
+        _mm_store_ps(pOut + 20, color);
+        _mm_store_ps(pOut + 24, _mm_add_ps(_mm_add_ps(base, diff), _mm_setr_ps(0, 0, 1, 0)));
+        _mm_store_ps(pOut + 28, color);
+#else
+        float x = input.positionX[i];
+        float y = input.positionY[i];
+        float sumX = ax + bx, sumY = ay + by;
+        float diffX = ax - bx, diffY = ay - by;
+        float color[4];
+        for (int c = 0; c < 4; ++c) color[c] = quadClass.colorFrom[c] + quadClass.colorDelta[c] * life;
+        pQuad[0] = {x - sumX, y - sumY, 0, 0, color[0], color[1], color[2], color[3]};
+        pQuad[1] = {x - diffX, y - diffY, 0, 1, color[0], color[1], color[2], color[3]};
+        pQuad[2] = {x + sumX, y + sumY, 1, 1, color[0], color[1], color[2], color[3]};
+        pQuad[3] = {x + diffX, y + diffY, 1, 0, color[0], color[1], color[2], color[3]};
+#endif
+    }
+}
+
+int buildParticleQuads(const ParticleQuadInput& input, ParticleQuadVertex* pVertices, ParticleQuadBatch* pBatches)
+{
+    // Counting sort by texture: count, then each texture gets its range
+    int counts[PARTICLE_QUAD_MAX_TEXTURES] = {0};
+    int offsets[PARTICLE_QUAD_MAX_TEXTURES];
+    countParticleQuads(input, 0, input.count, counts);
+    int batchCount = getParticleQuadBatches(counts, offsets, pBatches);
+    writeParticleQuads(input, 0, input.count, offsets, pVertices);
+    return batchCount;
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <cstdint>
+
+// Builds the quads of every live particle on the CPU, sorted by texture so
+// each texture is a single draw. Nothing from onut in here, the kernel only
+// sees plain arrays. tools/particlequads tests and times it on its own.
+
+#define PARTICLE_QUAD_MAX_TEXTURES 32
+
+// For the vertex arrays handed to the kernel. VS2013 has no alignas.
+#if defined(_MSC_VER)
+#define PARTICLE_QUAD_ALIGN __declspec(align(16))
+#else
+#define PARTICLE_QUAD_ALIGN __attribute__((aligned(16)))
+#endif
+
+// Same layout as Mesh::Vertex and onut's 2D vertex
+struct ParticleQuadVertex
+{
+    float x, y;
+    float u, v;
+    float r, g, b, a;
+};
+
+// Per particle class, everything the kernel interpolates along life
+struct ParticleQuadClass
+{
+    float colorFrom[4];
+    float colorDelta[4];    // colorTo - colorFrom
+    float halfSizeFrom;     // Half width in world units
+    float halfSizeDelta;
+    float aspect;           // Texture height / width
+    int textureSlot;
+};
+
+struct ParticleQuadInput
+{
+    int count;
+    const float* positionX;
+    const float* positionY;
+    const float* life;
+    const uint16_t* angle;          // 1/65536 of a turn
+    const uint16_t* particleClass;
+    const ParticleQuadClass* pClasses; // Indexed by particleClass
+    const uint8_t* visible;         // Optional, 1 per particle that gets a quad, 0 for culled ones
+};
+
+struct ParticleQuadBatch
+{
+    int textureSlot;
+    int firstQuad;
+    int quadCount;
+};
+
+// Quad i is vertices [4i, 4i + 4), drawn as triangles (0, 1, 2) and (0, 2, 3).
+// pVertices holds 4 * count vertices and is 16 bytes aligned, pBatches holds
+// PARTICLE_QUAD_MAX_TEXTURES. Returns the number of batches written.
+int buildParticleQuads(const ParticleQuadInput& input, ParticleQuadVertex* pVertices, ParticleQuadBatch* pBatches);
+
+// The same in steps, so ranges of particles can be built on different threads.
+// countParticleQuads adds the quads of the visible particles of
+// [first, first + count) per texture to pCounts. getParticleQuadBatches turns the totals into batches and the
+// offset of each texture's first quad. writeParticleQuads writes each quad at
+// pOffsets[its texture] and advances it.
+void countParticleQuads(const ParticleQuadInput& input, int first, int count, int* pCounts);
+int getParticleQuadBatches(const int* pCounts, int* pOffsets, ParticleQuadBatch* pBatches);
+void writeParticleQuads(const ParticleQuadInput& input, int first, int count, int* pOffsets, ParticleQuadVertex* pVertices);
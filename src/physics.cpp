@@ -0,0 +1,119 @@
+#include <algorithm>
+#include <cmath>
+
+#include "physics.h"
+
+// Same fixed steps as the orbit plot always had
+#define APSIS_STEP .1f
+#define APSIS_TIME_LIMIT 300.0f
+
+bool burnFuel(float& fuel, float burn, float dt)
+{
+    if (fuel <= 0) return false;
+    fuel = std::max(0.0f, fuel - burn * dt);
+    return true;
+}
+
+PhysicsForce getThrust(float worldX, float worldY, float worldAngle, float trust)
+{
+    // Toward the part's front, which is its up axis flipped
+    float forwardX = std::sin(worldAngle);
+    float forwardY = -std::cos(worldAngle);
+    return {forwardX * trust, forwardY * trust,
+            worldX - forwardX * THRUST_OFFSET, worldY - forwardY * THRUST_OFFSET};
+}
+
+float applyForce(RigidBody& body, float centerOfMassX, float centerOfMassY, float totalMass, const PhysicsForce& force, float dt)
+{
+    float c = std::cos(body.angle);
+    float s = std::sin(body.angle);
+    float worldComX = body.x + centerOfMassX * c - centerOfMassY * s;
+    float worldComY = body.y + centerOfMassX * s + centerOfMassY * c;
+
+    // Off center pushes spin the vehicle, by how far they are along its right axis
+    float dx = force.px - worldComX;
+    float dy = force.py - worldComY;
+    float length = std::sqrt(dx * dx + dy * dy);
+    float angularEffect = length > 0 ? (dx * c + dy * s) / length : 0;
+    body.vx += force.x / totalMass * dt;
+    body.vy += force.y / totalMass * dt;
+    body.angleVelocity -= (angularEffect / totalMass * 100) * dt;
+    return std::sqrt(force.x * force.x + force.y * force.y) / totalMass * dt;
+}
+
+void integrateBody(RigidBody& body, float totalMass, float stability, float dt)
+{
+    float radius = std::sqrt(body.x * body.x + body.y * body.y);
+    body.angle += body.angleVelocity * dt;
+    if (radius > 0)
+    {
+        body.vx -= body.x / radius * GRAVITY * dt;
+        body.vy -= body.y / radius * GRAVITY * dt;
+    }
+    body.x += body.vx * dt;
+    body.y += body.vy * dt;
+
+    float damping = stability / totalMass * 4 * dt;
+    if (body.angleVelocity > 0) body.angleVelocity = std::max(0.0f, body.angleVelocity - damping);
+    else if (body.angleVelocity < 0) body.angleVelocity = std::min(0.0f, body.angleVelocity + damping);
+}
+
+void getDecoupleKick(float vx, float vy, float& kickX, float& kickY)
+{
+    float speed = std::sqrt(vx * vx + vy * vy);
+    kickX = speed > 0 ? vx / speed : 0;
+    kickY = speed > 0 ? vy / speed : 0;
+}
+
+float getSpaceDistance()
+{
+    float d1 = ((float)ATMOSPHERES_COUNT);
+    d1 *= d1;
+    return PLANET_SIZE + PLANET_SIZE * ATMOSPHERES_SCALE * d1;
+}
+
+Apsides findApsides(float x, float y, float vx, float vy)
+{
+    Apsides apsides = {};
+    float radius = std::sqrt(x * x + y * y);
+    float speed = std::sqrt(vx * vx + vy * vy);
+    float currentDot = speed > 0 && radius > 0 ? (vx * x + vy * y) / (speed * radius) : 0;
+    if (currentDot >= 1 || currentDot <= -1) return apsides;
+    float time = 0.0f;
+    float testDot = currentDot;
+    while (apsides.count < 2 && time < APSIS_TIME_LIMIT)
+    {
+        while (((currentDot >= 0 && testDot >= 0) ||
+            (currentDot <= 0 && testDot <= 0)) && time < APSIS_TIME_LIMIT)
+        {
+            x += vx;
+            y += vy;
+            speed = std::sqrt(vx * vx + vy * vy);
+            radius = std::sqrt(x * x + y * y);
+            testDot = speed > 0 && radius > 0 ? (vx * x + vy * y) / (speed * radius) : 0;
+            if (radius > 0)
+            {
+                vx -= x / radius * GRAVITY;
+                vy -= y / radius * GRAVITY;
+            }
+            time += APSIS_STEP;
+        }
+        apsides.x[apsides.count] = x;
+        apsides.y[apsides.count] = y;
+        ++apsides.count;
+        currentDot = testDot;
+    }
+    apsides.isClosed = time < APSIS_TIME_LIMIT;
+    return apsides;
+}
+
+bool isStableOrbit(const Apsides& apsides)
+{
+    if (!apsides.isClosed) return false;
+    float spaceDistanceSq = getSpaceDistance() * getSpaceDistance();
+    for (int i = 0; i < 2; ++i)
+    {
+        if (apsides.x[i] * apsides.x[i] + apsides.y[i] * apsides.y[i] < spaceDistanceSq) return false;
+    }
+    return true;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+// Vehicle physics shared by updatePart in the game and the headless
+// simulation library (ojam16sim.h). Plain floats, no engine dependency and no
+// global state, so both always fly the same way.
+
+#define PLANET_SIZE 10000
+#define ATMOSPHERES_COUNT 4
+#define ATMOSPHERES_SCALE 0.05f
+#define GRAVITY 3.0f
+
+// Engines and boosters push from that far behind their center
+#define THRUST_OFFSET .75f
+
+// Root part of a vehicle, children ride along with it
+struct RigidBody
+{
+    float x, y;
+    float angle;
+    float vx, vy;
+    float angleVelocity;
+};
+
+// Force applied at a world position
+struct PhysicsForce
+{
+    float x, y;
+    float px, py;
+};
+
+// The tank an engine draws from: going up the parents from the engine and
+// without crossing a decoupler, the highest part that has liquid fuel left.
+// visit is called on every part on the way and returns its liquid fuel.
+template <typename Node, typename GetParent, typename IsDecoupler, typename Visit>
+Node findLiquidFuelTank(Node node, Node none, GetParent getParent, IsDecoupler isDecoupler, Visit visit)
+{
+    Node tank = none;
+    for (; node != none; node = getParent(node))
+    {
+        if (visit(node) > 0) tank = node;
+        auto parent = getParent(node);
+        if (parent == none || isDecoupler(parent)) break;
+    }
+    return tank;
+}
+
+// Burns the fuel of a firing engine or booster. Returns false once it's
+// empty, in which case there's no thrust.
+bool burnFuel(float& fuel, float burn, float dt);
+
+// Thrust of a firing part, worldAngle being its angle in world space
+PhysicsForce getThrust(float worldX, float worldY, float worldAngle, float trust);
+
+// centerOfMass is relative to the body. Returns the delta-v it gave.
+float applyForce(RigidBody& body, float centerOfMassX, float centerOfMassY, float totalMass, const PhysicsForce& force, float dt);
+
+// Gravity, motion, then the vehicle's stability damps its spin
+void integrateBody(RigidBody& body, float totalMass, float stability, float dt);
+
+// Velocity change pieces separated by a centered decoupler get: the top
+// of the vehicle one unit forward along its velocity, the rest one unit back.
+void getDecoupleKick(float vx, float vy, float& kickX, float& kickY);
+
+// Radius where the atmosphere ends
+float getSpaceDistance();
+
+// Apsis search of the orbit plot. The orbit is stepped coarsely, a second of
+// velocity per step, until the radial velocity changes sign twice or the time
+// limit is reached.
+struct Apsides
+{
+    float x[2], y[2];
+    int count;
+    bool isClosed;  // Both were found within the time limit
+};
+Apsides findApsides(float x, float y, float vx, float vy);
+
+// A payload only deploys as a satellite if both apsides are out of the atmosphere
+bool isStableOrbit(const Apsides& apsides);
@@ -0,0 +1,179 @@
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "analysis.h"
+#include "defines.h"
+#include "part.h"
+#include "predictor.h"
+
+#define PREDICTION_MAX_POINTS 2000
+#define PREDICTION_MAX_TIME 600.0f
+#define PREDICTION_CANCEL_CHECK 64
+#define PREDICTION_INTERVAL 10 // Ticks between requests
+
+struct PredictionRequest
+{
+    FlightWorld world;
+    FlightState state;
+    std::vector<FlightStage> stages;
+    int generation;
+};
+
+struct PredictionResult
+{
+    std::vector<Vector2> path;
+    int generation = -1;
+};
+
+static std::mutex predictorMutex;
+static std::condition_variable predictorCondition;
+static PredictionRequest pendingRequest;
+static bool hasPendingRequest = false;
+static PredictionResult completedResult; // Guarded by predictorMutex
+static bool hasCompletedResult = false;
+static std::atomic<int> latestGeneration(0);
+static bool isQuitting = false;
+
+static std::vector<Vector2> predictedPath; // Update thread only
+static int predictedGeneration = -1;
+
+static void predict(const PredictionRequest& request, PredictionResult& result)
+{
+    result.path.clear();
+    result.generation = request.generation;
+
+    auto state = request.state;
+    auto pStages = request.stages.data();
+    int stageCount = (int)request.stages.size();
+    float startAngle = std::atan2f(state.y, state.x);
+    float lastAngle = startAngle;
+    float travelled = 0;
+
+    result.path.push_back(Vector2(state.x, state.y));
+    int steps = 0;
+    while (!state.crashed &&
+           state.time < PREDICTION_MAX_TIME &&
+           (int)result.path.size() < PREDICTION_MAX_POINTS)
+    {
+        // Inputs changed since this was posted, don't bother finishing
+        if (++steps % PREDICTION_CANCEL_CHECK == 0 &&
+            latestGeneration.load(std::memory_order_relaxed) != request.generation)
+        {
+            result.path.clear();
+            return;
+        }
+
+        auto dt = getFlightStepSize(state, pStages, stageCount);
+        stepFlight(request.world, state, pStages, stageCount, dt);
+        result.path.push_back(Vector2(state.x, state.y));
+
+        // One full revolution is enough
+        float angle = std::atan2f(state.y, state.x);
+        travelled += std::fabsf(std::remainderf(angle - lastAngle, DirectX::XM_2PI));
+        lastAngle = angle;
+        if (travelled >= DirectX::XM_2PI) break;
+    }
+}
+
+static void predictorThread()
+{
+    PredictionRequest request;
+    PredictionResult result;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(predictorMutex);
+            predictorCondition.wait(lock, [] { return hasPendingRequest || isQuitting; });
+            if (isQuitting) return;
+            request.world = pendingRequest.world;
+            request.state = pendingRequest.state;
+            request.stages.swap(pendingRequest.stages);
+            request.generation = pendingRequest.generation;
+            hasPendingRequest = false;
+        }
+
+        predict(request, result);
+        if (result.path.empty()) continue;
+
+        {
+            std::lock_guard<std::mutex> lock(predictorMutex);
+            completedResult.path.swap(result.path);
+            completedResult.generation = result.generation;
+            hasCompletedResult = true;
+        }
+    }
+}
+
+struct PredictorWorker
+{
+    std::thread thread;
+
+    PredictorWorker()
+        : thread(predictorThread)
+    {
+    }
+
+    ~PredictorWorker()
+    {
+        {
+            std::lock_guard<std::mutex> lock(predictorMutex);
+            isQuitting = true;
+        }
+        predictorCondition.notify_one();
+        thread.join();
+    }
+};
+
+void requestPrediction()
+{
+    static int ticks = 0;
+    if (++ticks < PREDICTION_INTERVAL) return;
+    ticks = 0;
+    requestPredictionNow();
+}
+
+void requestPredictionNow()
+{
+    static PredictorWorker worker;
+    if (!pMainPart) return;
+
+    FlightState state;
+    std::vector<FlightStage> flightStages;
+    buildFlightModel(pMainPart, state, flightStages);
+    initFlightState(state, flightStages.data(), (int)flightStages.size());
+
+    {
+        // Worker only holds this while copying, this never waits on a simulation
+        std::lock_guard<std::mutex> lock(predictorMutex);
+        pendingRequest.world = {GRAVITY, (float)PLANET_SIZE};
+        pendingRequest.state = state;
+        pendingRequest.stages.swap(flightStages);
+        pendingRequest.generation = ++latestGeneration;
+        hasPendingRequest = true;
+    }
+    predictorCondition.notify_one();
+}
+
+void clearPrediction()
+{
+    predictedGeneration = ++latestGeneration;
+    predictedPath.clear();
+}
+
+void updatePrediction()
+{
+    std::unique_lock<std::mutex> lock(predictorMutex, std::try_to_lock);
+    if (!lock.owns_lock() || !hasCompletedResult) return;
+    hasCompletedResult = false;
+    if (completedResult.generation <= predictedGeneration) return;
+    predictedGeneration = completedResult.generation;
+    predictedPath.swap(completedResult.path);
+}
+
+const std::vector<Vector2>& getPredictedPath()
+{
+    return predictedPath;
+}
@@ -0,0 +1,12 @@
+#pragma once
+#include <onut/Maths.h>
+#include <vector>
+
+// Powered trajectory of the main vehicle, simulated on a worker thread. The
+// update thread only posts requests and picks up finished results, it never
+// waits on the worker.
+void requestPrediction();
+void requestPredictionNow();
+void clearPrediction();
+void updatePrediction();
+const std::vector<Vector2>& getPredictedPath();
@@ -0,0 +1,130 @@
+#include <onut/IndexBuffer.h>
+#include <onut/Renderer.h>
+#include <onut/Texture.h>
+#include <onut/VertexBuffer.h>
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+#include "renderqueue.h"
+
+struct RenderCommand
+{
+    uint64_t key; // Layer, blend mode, texture, then queue order
+    OTextureRef pTexture;
+    OVertexBufferRef pVB;
+    OIndexBufferRef pIB;
+    Matrix world;
+    uint32_t startIndex;
+    uint32_t indexCount;
+    OBlendMode blendMode;
+};
+
+RenderQueueStats renderQueueStats;
+
+static std::vector<RenderCommand> renderCommands;
+static std::vector<int> sortedCommands;
+static std::unordered_map<OTexture*, uint64_t> textureIds; // Stable sort order for textures
+
+static uint64_t getTextureId(OTexture* pTexture)
+{
+    auto it = textureIds.find(pTexture);
+    if (it != textureIds.end()) return it->second;
+    auto id = (uint64_t)textureIds.size();
+    textureIds[pTexture] = id;
+    return id;
+}
+
+static bool isPainterOrdered(int layer)
+{
+    return layer == RENDER_LAYER_VEHICLES || layer == RENDER_LAYER_VEHICLE_COVERS;
+}
+
+void queueDraw(int layer, OBlendMode blendMode, const OTextureRef& pTexture,
+               const OVertexBufferRef& pVB, const OIndexBufferRef& pIB,
+               const Matrix& world, uint32_t startIndex, uint32_t indexCount)
+{
+    if (!indexCount) return;
+    uint64_t key = ((uint64_t)layer << 56) | (uint64_t)renderCommands.size();
+    if (!isPainterOrdered(layer))
+    {
+        key |= ((uint64_t)blendMode << 48) | ((getTextureId(pTexture.get()) & 0xFFFF) << 32);
+    }
+    renderCommands.push_back({key, pTexture, pVB, pIB, world, startIndex, indexCount, blendMode});
+}
+
+void flushRenderQueue()
+{
+    if (renderCommands.empty()) return;
+    sortedCommands.resize(renderCommands.size());
+    for (int i = 0; i < (int)sortedCommands.size(); ++i) sortedCommands[i] = i;
+    std::sort(sortedCommands.begin(), sortedCommands.end(), [](int a, int b)
+    {
+        return renderCommands[a].key < renderCommands[b].key;
+    });
+
+    auto& renderStates = oRenderer->renderStates;
+    renderStates.primitiveMode = OPrimitiveTriangleList;
+
+    // Neighbours that share every state and continue each other's indices
+    // become one draw
+    const RenderCommand* pLast = nullptr;
+    uint32_t startIndex = 0;
+    uint32_t indexCount = 0;
+    for (auto index : sortedCommands)
+    {
+        auto& command = renderCommands[index];
+        ++renderQueueStats.commands;
+        bool isTextureChanged = !pLast || pLast->pTexture != command.pTexture;
+        bool isBlendChanged = !pLast || pLast->blendMode != command.blendMode;
+        bool isBufferChanged = !pLast || pLast->pVB != command.pVB || pLast->pIB != command.pIB;
+        bool isTransformChanged = !pLast || pLast->world != command.world;
+        if (!isTextureChanged && !isBlendChanged && !isBufferChanged && !isTransformChanged &&
+            command.startIndex == startIndex + indexCount)
+        {
+            indexCount += command.indexCount;
+            pLast = &command;
+            continue;
+        }
+
+        if (indexCount)
+        {
+            oRenderer->drawIndexed(indexCount, startIndex);
+            ++renderQueueStats.batches;
+        }
+        if (isTextureChanged)
+        {
+            renderStates.textures[0] = command.pTexture;
+            ++renderQueueStats.textureChanges;
+        }
+        if (isBlendChanged)
+        {
+            renderStates.blendMode = command.blendMode;
+            ++renderQueueStats.blendChanges;
+        }
+        if (isBufferChanged)
+        {
+            renderStates.vertexBuffer = command.pVB;
+            renderStates.indexBuffer = command.pIB;
+            ++renderQueueStats.bufferChanges;
+        }
+        if (isTransformChanged)
+        {
+            renderStates.world = command.world;
+            ++renderQueueStats.transformChanges;
+        }
+        startIndex = command.startIndex;
+        indexCount = command.indexCount;
+        pLast = &command;
+    }
+    oRenderer->drawIndexed(indexCount, startIndex);
+    ++renderQueueStats.batches;
+
+    renderCommands.clear();
+}
+
+void resetRenderQueueStats()
+{
+    renderQueueStats = RenderQueueStats();
+}
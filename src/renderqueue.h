@@ -0,0 +1,40 @@
+#pragma once
+#include <onut/Maths.h>
+#include <onut/BlendMode.h>
+#include <onut/ForwardDeclaration.h>
+OForwardDeclare(Texture);
+OForwardDeclare(VertexBuffer);
+OForwardDeclare(IndexBuffer);
+
+// World space draws of a frame, queued then submitted together sorted by
+// layer, blend mode and texture. Inside a layer, draws of the same texture
+// keep the order they were queued in. Vehicle sprites overlap, their layers
+// keep the queue order only, parents under children and vehicle by vehicle.
+
+#define RENDER_LAYER_PLANET 0
+#define RENDER_LAYER_BACKGROUND 1
+#define RENDER_LAYER_VEHICLES 2
+#define RENDER_LAYER_VEHICLE_COVERS 3   // Decouplers and engine covers
+#define RENDER_LAYER_PARTICLES 4
+
+// Counted over every flush of the frame
+struct RenderQueueStats
+{
+    int commands = 0;
+    int batches = 0;            // Draw calls issued
+    int textureChanges = 0;
+    int blendChanges = 0;
+    int bufferChanges = 0;
+    int transformChanges = 0;
+};
+
+extern RenderQueueStats renderQueueStats;
+
+// Triangle list, indexCount indices starting at startIndex
+void queueDraw(int layer, OBlendMode blendMode, const OTextureRef& pTexture,
+               const OVertexBufferRef& pVB, const OIndexBufferRef& pIB,
+               const Matrix& world, uint32_t startIndex, uint32_t indexCount);
+
+// Submits and empties the queue with the camera currently set
+void flushRenderQueue();
+void resetRenderQueueStats();
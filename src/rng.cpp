@@ -0,0 +1,123 @@
+#include <cstring>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define RNG_SSE2
+#endif
+
+#include "rng.h"
+
+#define RNG_FLOAT_SCALE (1.0f / 16777216.0f) // Top 24 bits to [0, 1)
+
+RandomStream randomStreams[RANDOM_STREAM_COUNT];
+
+static uint64_t splitMix64(uint64_t& x)
+{
+    uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+void seedRandomStream(int stream, uint64_t seed)
+{
+    auto& r = randomStreams[stream];
+    for (int lane = 0; lane < 4; ++lane)
+    {
+        for (int word = 0; word < 4; word += 2)
+        {
+            auto bits = splitMix64(seed);
+            r.s[word][lane] = (uint32_t)bits;
+            r.s[word + 1][lane] = (uint32_t)(bits >> 32);
+        }
+    }
+    r.lane = 0;
+}
+
+static inline uint32_t rotl(uint32_t x, int k)
+{
+    return (x << k) | (x >> (32 - k));
+}
+
+// Scalar draws take the lanes in turn
+uint32_t randUInt(int stream)
+{
+    auto& r = randomStreams[stream];
+    int lane = r.lane;
+    r.lane = (lane + 1) & 3;
+    auto& s0 = r.s[0][lane];
+    auto& s1 = r.s[1][lane];
+    auto& s2 = r.s[2][lane];
+    auto& s3 = r.s[3][lane];
+    uint32_t result = s0 + s3;
+    uint32_t t = s1 << 9;
+    s2 ^= s0;
+    s3 ^= s1;
+    s1 ^= s2;
+    s0 ^= s3;
+    s2 ^= t;
+    s3 = rotl(s3, 11);
+    return result;
+}
+
+float randFloat(int stream, float from, float to)
+{
+    return from + (to - from) * (float)(randUInt(stream) >> 8) * RNG_FLOAT_SCALE;
+}
+
+int randInt(int stream, int from, int to)
+{
+    auto range = (uint64_t)((int64_t)to - from + 1);
+    return from + (int)(((uint64_t)randUInt(stream) * range) >> 32);
+}
+
+Vector2 randVector2(int stream, const Vector2& from, const Vector2& to)
+{
+    float x = randFloat(stream, from.x, to.x);
+    float y = randFloat(stream, from.y, to.y);
+    return Vector2(x, y);
+}
+
+void fillRandomFloats(int stream, float* pOut, int count, float from, float to)
+{
+    auto& r = randomStreams[stream];
+    float range = to - from;
+    int i = 0;
+
+#if defined(RNG_SSE2)
+    // All 4 lanes step together. Lanes stay in sync with scalar draws
+    // because every lane moves once per 4 outputs either way, as long as
+    // batches start on lane 0.
+    if (r.lane == 0)
+    {
+        __m128i s0 = _mm_loadu_si128((const __m128i*)r.s[0]);
+        __m128i s1 = _mm_loadu_si128((const __m128i*)r.s[1]);
+        __m128i s2 = _mm_loadu_si128((const __m128i*)r.s[2]);
+        __m128i s3 = _mm_loadu_si128((const __m128i*)r.s[3]);
+        const __m128 scale = _mm_set1_ps(range * RNG_FLOAT_SCALE);
+        const __m128 offset = _mm_set1_ps(from);
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128i result = _mm_add_epi32(s0, s3);
+            __m128i t = _mm_slli_epi32(s1, 9);
+            s2 = _mm_xor_si128(s2, s0);
+            s3 = _mm_xor_si128(s3, s1);
+            s1 = _mm_xor_si128(s1, s2);
+            s0 = _mm_xor_si128(s0, s3);
+            s2 = _mm_xor_si128(s2, t);
+            s3 = _mm_or_si128(_mm_slli_epi32(s3, 11), _mm_srli_epi32(s3, 21));
+            __m128 f = _mm_cvtepi32_ps(_mm_srli_epi32(result, 8));
+            _mm_storeu_ps(pOut + i, _mm_add_ps(_mm_mul_ps(f, scale), offset));
+        }
+        _mm_storeu_si128((__m128i*)r.s[0], s0);
+        _mm_storeu_si128((__m128i*)r.s[1], s1);
+        _mm_storeu_si128((__m128i*)r.s[2], s2);
+        _mm_storeu_si128((__m128i*)r.s[3], s3);
+    }
+#endif
+
+    for (; i < count; ++i)
+    {
+        pOut[i] = from + range * (float)(randUInt(stream) >> 8) * RNG_FLOAT_SCALE;
+    }
+}
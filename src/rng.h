@@ -0,0 +1,28 @@
+#pragma once
+#include <onut/Maths.h>
+#include <cstdint>
+
+// xoshiro128+ streams, 4 interleaved lanes each so batches can be drawn
+// with SSE2. Each stream only depends on its own seed and on how many
+// numbers were drawn from it, not on what other systems did.
+#define RANDOM_STREAM_PHYSICS 0
+#define RANDOM_STREAM_EFFECTS 1
+#define RANDOM_STREAM_AUDIO 2
+#define RANDOM_STREAM_COUNT 3
+
+struct RandomStream
+{
+    uint32_t s[4][4]; // [state word][lane]
+    int lane;
+};
+
+extern RandomStream randomStreams[RANDOM_STREAM_COUNT];
+
+void seedRandomStream(int stream, uint64_t seed);
+uint32_t randUInt(int stream);
+float randFloat(int stream, float from, float to);
+int randInt(int stream, int from, int to); // Inclusive, like ORandInt
+Vector2 randVector2(int stream, const Vector2& from, const Vector2& to);
+
+// count floats in [from, to), 4 at a time
+void fillRandomFloats(int stream, float* pOut, int count, float from, float to);
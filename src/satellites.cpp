@@ -0,0 +1,197 @@
+#include <onut/PrimitiveBatch.h>
+#include <onut/Renderer.h>
+
+#include <cmath>
+#include <fstream>
+
+#include "coverage.h"
+#include "defines.h"
+#include "satellites.h"
+
+#define SATELLITE_CATALOG_FILE "satellites.dat"
+#define SATELLITE_CATALOG_MAGIC 0x43534A4F // "OJSC"
+#define SATELLITE_CATALOG_VERSION 1
+
+SatelliteCatalog satelliteCatalog;
+
+void loadSatelliteCatalog()
+{
+    std::ifstream file(SATELLITE_CATALOG_FILE, std::ios::binary);
+    if (!file.is_open()) return;
+
+    uint32_t header[3] = {0};
+    file.read((char*)header, sizeof(header));
+    if (!file ||
+        header[0] != SATELLITE_CATALOG_MAGIC ||
+        header[1] != SATELLITE_CATALOG_VERSION)
+    {
+        return;
+    }
+
+    auto count = (size_t)header[2];
+    auto& catalog = satelliteCatalog;
+    std::vector<float>* arrays[] = {
+        &catalog.guideRadius,
+        &catalog.guidePhase,
+        &catalog.angularRate,
+        &catalog.epicyclePhase,
+        &catalog.epicycleRate,
+        &catalog.radialAmplitude,
+        &catalog.angularAmplitude
+    };
+    for (auto pArray : arrays)
+    {
+        pArray->resize(count);
+        file.read((char*)pArray->data(), count * sizeof(float));
+    }
+    catalog.texture.resize(count);
+    file.read((char*)catalog.texture.data(), count);
+    if (!file)
+    {
+        // Truncated file, start over rather than propagating garbage
+        for (auto pArray : arrays) pArray->clear();
+        catalog.texture.clear();
+        return;
+    }
+    catalog.x.resize(count);
+    catalog.y.resize(count);
+    catalog.angle.resize(count);
+    catalog.radius.resize(count);
+    updateSatellites(0);
+}
+
+void saveSatelliteCatalog()
+{
+    std::ofstream file(SATELLITE_CATALOG_FILE, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) return;
+
+    auto& catalog = satelliteCatalog;
+    uint32_t header[3] = {SATELLITE_CATALOG_MAGIC, SATELLITE_CATALOG_VERSION, (uint32_t)catalog.size()};
+    file.write((const char*)header, sizeof(header));
+    const std::vector<float>* arrays[] = {
+        &catalog.guideRadius,
+        &catalog.guidePhase,
+        &catalog.angularRate,
+        &catalog.epicyclePhase,
+        &catalog.epicycleRate,
+        &catalog.radialAmplitude,
+        &catalog.angularAmplitude
+    };
+    for (auto pArray : arrays)
+    {
+        file.write((const char*)pArray->data(), pArray->size() * sizeof(float));
+    }
+    file.write((const char*)catalog.texture.data(), catalog.texture.size());
+}
+
+void catalogSatellite(const Vector2& position, const Vector2& vel, int texture)
+{
+    // Split the velocity into radial and tangential components
+    auto r = position.Length();
+    if (r <= 0.0f) return;
+    auto radialDir = position / r;
+    auto radialVel = vel.Dot(radialDir);
+    auto tangentialVel = radialDir.x * vel.y - radialDir.y * vel.x;
+    auto angularMomentum = r * tangentialVel;
+    if (angularMomentum == 0.0f) return; // Straight fall, not an orbit
+
+    // Circular orbit with the same angular momentum: v^2 / r0 = g
+    auto guideRadius = std::cbrtf(angularMomentum * angularMomentum / GRAVITY);
+    auto angularRate = angularMomentum / (guideRadius * guideRadius);
+
+    // Radial oscillation around it. For a constant central force the
+    // epicyclic frequency is sqrt(3) times the orbital frequency.
+    auto epicycleRate = std::sqrtf(3.0f) * std::fabsf(angularRate);
+    auto dr = r - guideRadius;
+    auto radialAmplitude = std::sqrtf(dr * dr + (radialVel / epicycleRate) * (radialVel / epicycleRate));
+    auto epicyclePhase = std::atan2f(-radialVel / epicycleRate, dr);
+    auto angularAmplitude = 2.0f * angularRate * radialAmplitude / (epicycleRate * guideRadius);
+    auto guidePhase = std::atan2f(position.y, position.x) + angularAmplitude * std::sinf(epicyclePhase);
+
+    auto& catalog = satelliteCatalog;
+    catalog.guideRadius.push_back(guideRadius);
+    catalog.guidePhase.push_back(guidePhase);
+    catalog.angularRate.push_back(angularRate);
+    catalog.epicyclePhase.push_back(epicyclePhase);
+    catalog.epicycleRate.push_back(epicycleRate);
+    catalog.radialAmplitude.push_back(radialAmplitude);
+    catalog.angularAmplitude.push_back(angularAmplitude);
+    catalog.texture.push_back((uint8_t)texture);
+    catalog.x.push_back(position.x);
+    catalog.y.push_back(position.y);
+    catalog.angle.push_back(std::atan2f(position.y, position.x));
+    catalog.radius.push_back(r);
+
+    saveSatelliteCatalog();
+}
+
+void truncateSatelliteCatalog(int count)
+{
+    auto& catalog = satelliteCatalog;
+    if (count < 0 || count >= catalog.size()) return;
+    catalog.guideRadius.resize(count);
+    catalog.guidePhase.resize(count);
+    catalog.angularRate.resize(count);
+    catalog.epicyclePhase.resize(count);
+    catalog.epicycleRate.resize(count);
+    catalog.radialAmplitude.resize(count);
+    catalog.angularAmplitude.resize(count);
+    catalog.texture.resize(count);
+    catalog.x.resize(count);
+    catalog.y.resize(count);
+    catalog.angle.resize(count);
+    catalog.radius.resize(count);
+    truncateCoverage(count);
+    saveSatelliteCatalog();
+}
+
+static inline float wrapAngle(float angle)
+{
+    return angle - DirectX::XM_2PI * std::floorf((angle + DirectX::XM_PI) / DirectX::XM_2PI);
+}
+
+void updateSatellites(float dt)
+{
+    auto& catalog = satelliteCatalog;
+    int count = catalog.size();
+
+    // Plain loops over contiguous arrays, no branches, so they vectorize
+    float* __restrict guidePhase = catalog.guidePhase.data();
+    float* __restrict epicyclePhase = catalog.epicyclePhase.data();
+    const float* __restrict angularRate = catalog.angularRate.data();
+    const float* __restrict epicycleRate = catalog.epicycleRate.data();
+    for (int i = 0; i < count; ++i)
+    {
+        guidePhase[i] = wrapAngle(guidePhase[i] + angularRate[i] * dt);
+        epicyclePhase[i] = wrapAngle(epicyclePhase[i] + epicycleRate[i] * dt);
+    }
+
+    const float* __restrict guideRadius = catalog.guideRadius.data();
+    const float* __restrict radialAmplitude = catalog.radialAmplitude.data();
+    const float* __restrict angularAmplitude = catalog.angularAmplitude.data();
+    float* __restrict x = catalog.x.data();
+    float* __restrict y = catalog.y.data();
+    float* __restrict angle = catalog.angle.data();
+    float* __restrict radius = catalog.radius.data();
+    for (int i = 0; i < count; ++i)
+    {
+        radius[i] = guideRadius[i] + radialAmplitude[i] * std::cosf(epicyclePhase[i]);
+        angle[i] = guidePhase[i] - angularAmplitude[i] * std::sinf(epicyclePhase[i]);
+        x[i] = std::cosf(angle[i]) * radius[i];
+        y[i] = std::sinf(angle[i]) * radius[i];
+    }
+}
+
+void drawSatellites(float zoom)
+{
+    auto& catalog = satelliteCatalog;
+    int count = catalog.size();
+    if (!count) return;
+    oPrimitiveBatch->begin(OPrimitivePointList);
+    oRenderer->set2DCameraOffCenter(Vector2::Zero, zoom);
+    for (int i = 0; i < count; ++i)
+    {
+        oPrimitiveBatch->draw(Vector2(catalog.x[i], catalog.y[i]), Color(0, 1, 1));
+    }
+    oPrimitiveBatch->end();
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <onut/Maths.h>
+#include <cstdint>
+#include <vector>
+
+// Every satellite ever put in orbit. Stored as structure of arrays so the
+// whole catalog is propagated in a single pass each frame.
+//
+// Gravity in the game is a constant pull toward the planet center, so orbits
+// are not conics. Each orbit is described as an epicycle around a circular
+// guiding orbit, which is exact for circular orbits and first order accurate
+// in eccentricity.
+struct SatelliteCatalog
+{
+    // Orbital elements
+    std::vector<float> guideRadius;     // Radius of the circular guiding orbit
+    std::vector<float> guidePhase;      // Current angle along the guiding orbit
+    std::vector<float> angularRate;     // Angular velocity of the guiding orbit (signed)
+    std::vector<float> epicyclePhase;   // Current phase of the radial oscillation
+    std::vector<float> epicycleRate;    // Radial oscillation frequency
+    std::vector<float> radialAmplitude; // Radial oscillation amplitude
+    std::vector<float> angularAmplitude;// Angular deviation caused by the oscillation
+    std::vector<uint8_t> texture;       // SATELLITE_1..4
+
+    // Propagated positions
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> angle;
+    std::vector<float> radius;
+
+    int size() const { return (int)guideRadius.size(); }
+};
+
+extern SatelliteCatalog satelliteCatalog;
+
+void loadSatelliteCatalog();
+void saveSatelliteCatalog();
+void catalogSatellite(const Vector2& position, const Vector2& vel, int texture);
+void truncateSatelliteCatalog(int count); // Forgets satellites cataloged after a snapshot
+void updateSatellites(float dt);
+void drawSatellites(float zoom);
@@ -0,0 +1,57 @@
+#pragma once
+#include <cstdint>
+
+#include "ojam16sim.h"
+
+// Wire format of the ojam16simd daemon. Everything is native endian, the
+// daemon only listens on a local socket: a Unix domain socket, or on Windows
+// a port on 127.0.0.1.
+//
+// A request is a SimRequestHeader followed by partCount SimRequestParts and
+// stageTickCount uint32_t, the ticks at which the next stage fires. Clients
+// may send as many requests as they want without waiting, responses come
+// back as they finish, matched by id, in any order.
+//
+// A response is a SimResponseHeader followed by the final telemetry and
+// telemetryCount samples, one every telemetryInterval ticks.
+
+#define SIM_REQUEST_MAGIC 0x51534A4F    // "OJSQ"
+#define SIM_RESPONSE_MAGIC 0x52534A4F   // "OJSR"
+#define SIM_MAX_FRAME_SIZE (1 << 20)
+#define SIM_MAX_TICKS (60 * 60 * 60)
+#define SIM_DEFAULT_PORT "47160"
+
+#define SIM_STATUS_OK 0
+#define SIM_STATUS_BAD_DESIGN 1
+
+struct SimRequestHeader
+{
+    uint32_t magic;
+    uint32_t size;              // Whole frame, header included
+    uint32_t id;
+    uint32_t seed;
+    uint32_t partCount;
+    uint32_t stageTickCount;
+    uint32_t tickCount;
+    float dt;
+    uint32_t telemetryInterval; // 0 for the final state only
+};
+
+struct SimRequestPart
+{
+    int32_t partId;
+    int32_t parent;
+    float x, y;
+    float angle;
+    int32_t stage;
+};
+
+struct SimResponseHeader
+{
+    uint32_t magic;
+    uint32_t size;
+    uint32_t id;
+    int32_t status;
+    uint32_t ticksRun;
+    uint32_t telemetryCount;
+};
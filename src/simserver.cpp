@@ -0,0 +1,487 @@
+// ojam16simd: headless simulation daemon on a local socket, see simprotocol.h
+//
+// usage: ojam16simd [socket path] [parts csv]
+//
+// On Windows the first argument is a port on 127.0.0.1 instead. afunix.h only
+// ships with the Windows 10 SDK and the project builds with v120.
+//
+// The catalog is loaded once. Each connection has a reader that hands every
+// complete request it got from one recv to the worker pool in a single batch,
+// and a writer that sends everything finished since its last send at once.
+// Ctrl+C stops accepting, drops queued jobs and joins every thread.
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <winsock2.h>
+#include <windows.h>
+using Socket = SOCKET;
+#define SEND_FLAGS 0
+#define SHUT_RDWR SD_BOTH
+#else
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+using Socket = int;
+#define INVALID_SOCKET -1
+#define closesocket close
+#define SEND_FLAGS MSG_NOSIGNAL
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "simprotocol.h"
+
+#define SIM_RECV_SIZE (64 * 1024)
+#define SIM_JOBS_PER_GRAB 16
+
+struct Connection
+{
+    Socket socket;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::vector<uint8_t> outbox;
+    int pendingJobs = 0;
+    bool isReadDone = false;
+    bool isClosed = false;
+};
+
+struct Session
+{
+    std::shared_ptr<Connection> pConnection;
+    std::thread reader;
+    std::thread writer;
+};
+
+struct SimJob
+{
+    std::shared_ptr<Connection> pConnection;
+    std::vector<uint8_t> request;
+};
+
+static ojsim_catalog* pCatalog = nullptr;
+static std::mutex queueMutex;
+static std::condition_variable queueWake;
+static std::deque<SimJob> jobQueue;
+static std::atomic<bool> isShuttingDown(false);
+static Socket listener = INVALID_SOCKET;
+
+//--- Jobs
+
+static void writeResponse(std::vector<uint8_t>& out, uint32_t id, int32_t status, uint32_t ticksRun,
+                          const ojsim_telemetry& final, const ojsim_telemetry* pSamples, uint32_t sampleCount)
+{
+    SimResponseHeader header = {
+        SIM_RESPONSE_MAGIC,
+        (uint32_t)(sizeof(SimResponseHeader) + (1 + sampleCount) * sizeof(ojsim_telemetry)),
+        id, status, ticksRun, sampleCount};
+    auto offset = out.size();
+    out.resize(offset + header.size);
+    auto pOut = out.data() + offset;
+    memcpy(pOut, &header, sizeof(header));
+    pOut += sizeof(header);
+    memcpy(pOut, &final, sizeof(final));
+    pOut += sizeof(final);
+    for (uint32_t i = 0; i < sampleCount; ++i)
+    {
+        memcpy(pOut, &pSamples[i], sizeof(ojsim_telemetry));
+        pOut += sizeof(ojsim_telemetry);
+    }
+}
+
+static void runJob(const std::vector<uint8_t>& request, std::vector<uint8_t>& out, std::vector<ojsim_telemetry>& telemetry)
+{
+    SimRequestHeader header;
+    memcpy(&header, request.data(), sizeof(header));
+    ojsim_telemetry final = {};
+
+    uint64_t expectedSize = sizeof(SimRequestHeader) +
+                            (uint64_t)header.partCount * sizeof(SimRequestPart) +
+                            (uint64_t)header.stageTickCount * sizeof(uint32_t);
+    if (expectedSize != header.size || header.tickCount > SIM_MAX_TICKS || !(header.dt > 0))
+    {
+        writeResponse(out, header.id, SIM_STATUS_BAD_DESIGN, 0, final, nullptr, 0);
+        return;
+    }
+
+    auto pSim = ojsim_create(pCatalog, header.seed);
+    auto pParts = request.data() + sizeof(SimRequestHeader);
+    for (uint32_t i = 0; i < header.partCount; ++i)
+    {
+        SimRequestPart part;
+        memcpy(&part, pParts + i * sizeof(SimRequestPart), sizeof(part));
+        if (ojsim_add_part(pSim, part.partId, part.parent, part.x, part.y, part.angle, part.stage) == -1)
+        {
+            ojsim_destroy(pSim);
+            writeResponse(out, header.id, SIM_STATUS_BAD_DESIGN, 0, final, nullptr, 0);
+            return;
+        }
+    }
+
+    std::vector<uint32_t> stageTicks(header.stageTickCount);
+    if (!stageTicks.empty())
+    {
+        memcpy(stageTicks.data(), pParts + header.partCount * sizeof(SimRequestPart), stageTicks.size() * sizeof(uint32_t));
+    }
+    std::sort(stageTicks.begin(), stageTicks.end());
+    stageTicks.push_back(header.tickCount);
+
+    // Steps without telemetry, records are only taken for the samples and
+    // the final state
+    auto interval = header.telemetryInterval;
+    telemetry.clear();
+    uint32_t ticksRun = 0;
+    bool hasCrashed = false;
+    for (auto stageTick : stageTicks)
+    {
+        stageTick = std::min(stageTick, header.tickCount);
+        while (ticksRun < stageTick)
+        {
+            auto until = stageTick;
+            if (interval) until = (uint32_t)std::min<uint64_t>(until, ((uint64_t)ticksRun / interval + 1) * interval);
+            auto wanted = until - ticksRun;
+            auto ran = (uint32_t)ojsim_step(pSim, (int)wanted, header.dt, nullptr);
+            ticksRun += ran;
+            if (ran < wanted)
+            {
+                hasCrashed = true;
+                break;
+            }
+            if (interval && ticksRun % interval == 0)
+            {
+                telemetry.push_back({});
+                ojsim_get_telemetry(pSim, &telemetry.back());
+            }
+        }
+        if (hasCrashed) break;
+        if (ticksRun < header.tickCount) ojsim_activate_next_stage(pSim);
+    }
+    if (ticksRun) ojsim_get_telemetry(pSim, &final);
+    ojsim_destroy(pSim);
+
+    writeResponse(out, header.id, SIM_STATUS_OK, ticksRun, final, telemetry.data(), (uint32_t)telemetry.size());
+}
+
+static void workerThread()
+{
+    std::vector<SimJob> jobs;
+    std::vector<uint8_t> out;
+    std::vector<ojsim_telemetry> telemetry;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueWake.wait(lock, [] { return !jobQueue.empty() || isShuttingDown; });
+            if (isShuttingDown) return;
+            int count = std::min((int)jobQueue.size(), SIM_JOBS_PER_GRAB);
+            for (int i = 0; i < count; ++i)
+            {
+                jobs.push_back(std::move(jobQueue.front()));
+                jobQueue.pop_front();
+            }
+        }
+
+        // Grabbed jobs usually come from the same connection, hand their
+        // responses over together
+        for (size_t i = 0; i < jobs.size();)
+        {
+            auto pConnection = jobs[i].pConnection;
+            int finished = 0;
+            out.clear();
+            for (; i < jobs.size() && jobs[i].pConnection == pConnection; ++i, ++finished)
+            {
+                runJob(jobs[i].request, out, telemetry);
+            }
+            {
+                std::lock_guard<std::mutex> lock(pConnection->mutex);
+                pConnection->outbox.insert(pConnection->outbox.end(), out.begin(), out.end());
+                pConnection->pendingJobs -= finished;
+            }
+            pConnection->wake.notify_one();
+        }
+        jobs.clear();
+    }
+}
+
+//--- Connections
+
+static bool sendAll(Socket socket, const uint8_t* pData, size_t size)
+{
+    while (size)
+    {
+        auto sent = send(socket, (const char*)pData, (int)std::min(size, (size_t)SIM_MAX_FRAME_SIZE), SEND_FLAGS);
+        if (sent <= 0) return false;
+        pData += sent;
+        size -= (size_t)sent;
+    }
+    return true;
+}
+
+// Also wakes up a reader blocked in recv
+static void closeConnection(Connection& connection)
+{
+    std::lock_guard<std::mutex> lock(connection.mutex);
+    if (connection.isClosed) return;
+    connection.isClosed = true;
+    shutdown(connection.socket, SHUT_RDWR);
+    closesocket(connection.socket);
+}
+
+static void writerThread(std::shared_ptr<Connection> pConnection)
+{
+    std::vector<uint8_t> sending;
+    bool isBroken = false;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(pConnection->mutex);
+            pConnection->wake.wait(lock, [&]
+            {
+                return !pConnection->outbox.empty() ||
+                       (pConnection->isReadDone && !pConnection->pendingJobs) ||
+                       isShuttingDown;
+            });
+            if (pConnection->outbox.empty() || isShuttingDown) break;
+            std::swap(sending, pConnection->outbox);
+        }
+        if (!isBroken) isBroken = !sendAll(pConnection->socket, sending.data(), sending.size());
+        sending.clear();
+    }
+    closeConnection(*pConnection);
+}
+
+static void readerThread(std::shared_ptr<Connection> pConnection)
+{
+    std::vector<uint8_t> buffer;
+    std::vector<SimJob> batch;
+    size_t consumed = 0;
+    bool isValid = true;
+    while (isValid)
+    {
+        auto offset = buffer.size();
+        buffer.resize(offset + SIM_RECV_SIZE);
+        auto received = recv(pConnection->socket, (char*)buffer.data() + offset, SIM_RECV_SIZE, 0);
+        if (received <= 0) break;
+        buffer.resize(offset + (size_t)received);
+
+        // Every complete frame we have goes out in one batch
+        while (buffer.size() - consumed >= sizeof(SimRequestHeader))
+        {
+            SimRequestHeader header;
+            memcpy(&header, buffer.data() + consumed, sizeof(header));
+            if (header.magic != SIM_REQUEST_MAGIC ||
+                header.size < sizeof(SimRequestHeader) ||
+                header.size > SIM_MAX_FRAME_SIZE)
+            {
+                isValid = false;
+                break;
+            }
+            if (buffer.size() - consumed < header.size) break;
+            auto pFrame = buffer.data() + consumed;
+            batch.push_back({pConnection, std::vector<uint8_t>(pFrame, pFrame + header.size)});
+            consumed += header.size;
+        }
+        buffer.erase(buffer.begin(), buffer.begin() + consumed);
+        consumed = 0;
+
+        if (!batch.empty())
+        {
+            {
+                std::lock_guard<std::mutex> lock(pConnection->mutex);
+                pConnection->pendingJobs += (int)batch.size();
+            }
+            {
+                std::lock_guard<std::mutex> lock(queueMutex);
+                for (auto& job : batch) jobQueue.push_back(std::move(job));
+            }
+            if (batch.size() == 1) queueWake.notify_one();
+            else queueWake.notify_all();
+            batch.clear();
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(pConnection->mutex);
+        pConnection->isReadDone = true;
+    }
+    pConnection->wake.notify_one();
+}
+
+#ifdef _WIN32
+static BOOL WINAPI onConsoleCtrl(DWORD)
+{
+    isShuttingDown = true;
+    closesocket(listener); // Wakes up accept
+    return TRUE;
+}
+
+static Socket listenOn(const char* port)
+{
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons((u_short)atoi(port));
+    auto socket = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (socket == INVALID_SOCKET) return INVALID_SOCKET;
+    if (bind(socket, (sockaddr*)&address, sizeof(address)) != 0 || listen(socket, SOMAXCONN) != 0)
+    {
+        closesocket(socket);
+        return INVALID_SOCKET;
+    }
+    return socket;
+}
+
+static void blockSignals(bool)
+{
+}
+#else
+static void onSignal(int)
+{
+    isShuttingDown = true; // accept returns EINTR, no SA_RESTART
+}
+
+// Threads keep the mask they were started with, blocked in all of them so
+// signals only land on the main thread and interrupt accept
+static void blockSignals(bool isBlocked)
+{
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(isBlocked ? SIG_BLOCK : SIG_UNBLOCK, &signals, nullptr);
+}
+
+static Socket listenOn(const char* path)
+{
+    unlink(path);
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+    auto socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (socket == INVALID_SOCKET) return INVALID_SOCKET;
+    if (bind(socket, (sockaddr*)&address, sizeof(address)) != 0 || listen(socket, SOMAXCONN) != 0)
+    {
+        closesocket(socket);
+        return INVALID_SOCKET;
+    }
+    return socket;
+}
+#endif
+
+// Sessions whose writer is done, so both threads are about to return
+static void joinClosedSessions(std::vector<Session>& sessions)
+{
+    for (auto it = sessions.begin(); it != sessions.end();)
+    {
+        bool isClosed;
+        {
+            std::lock_guard<std::mutex> lock(it->pConnection->mutex);
+            isClosed = it->pConnection->isClosed;
+        }
+        if (!isClosed)
+        {
+            ++it;
+            continue;
+        }
+        it->reader.join();
+        it->writer.join();
+        it = sessions.erase(it);
+    }
+}
+
+int main(int argc, char** argv)
+{
+#ifdef _WIN32
+    const char* address = argc > 1 ? argv[1] : SIM_DEFAULT_PORT;
+#else
+    const char* address = argc > 1 ? argv[1] : "ojam16sim.sock";
+#endif
+    const char* partsPath = argc > 2 ? argv[2] : "ojam16 - parts.csv";
+
+    pCatalog = ojsim_catalog_load(partsPath);
+    if (!pCatalog)
+    {
+        fprintf(stderr, "Can't load %s\n", partsPath);
+        return 1;
+    }
+
+#ifdef _WIN32
+    WSADATA wsaData;
+    WSAStartup(MAKEWORD(2, 2), &wsaData);
+#endif
+    listener = listenOn(address);
+    if (listener == INVALID_SOCKET)
+    {
+        fprintf(stderr, "Can't listen on %s\n", address);
+        return 1;
+    }
+#ifdef _WIN32
+    SetConsoleCtrlHandler(onConsoleCtrl, TRUE);
+#else
+    struct sigaction action = {};
+    action.sa_handler = onSignal;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+#endif
+
+    int workerCount = std::max(1, (int)std::thread::hardware_concurrency());
+    std::vector<std::thread> workers;
+    blockSignals(true);
+    for (int i = 0; i < workerCount; ++i) workers.push_back(std::thread(workerThread));
+    blockSignals(false);
+    printf("Listening on %s with %i workers\n", address, workerCount);
+
+    std::vector<Session> sessions;
+    while (!isShuttingDown)
+    {
+        auto client = accept(listener, nullptr, nullptr);
+        if (client == INVALID_SOCKET) continue;
+#ifdef _WIN32
+        BOOL noDelay = TRUE;
+        setsockopt(client, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+#endif
+        joinClosedSessions(sessions);
+        Session session;
+        session.pConnection = std::make_shared<Connection>();
+        session.pConnection->socket = client;
+        blockSignals(true);
+        session.reader = std::thread(readerThread, session.pConnection);
+        session.writer = std::thread(writerThread, session.pConnection);
+        blockSignals(false);
+        sessions.push_back(std::move(session));
+    }
+
+    // Queued jobs are dropped, the workers finish the ones they hold
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        jobQueue.clear();
+    }
+    queueWake.notify_all();
+    for (auto& worker : workers) worker.join();
+    for (auto& session : sessions)
+    {
+        closeConnection(*session.pConnection);
+        session.pConnection->wake.notify_one();
+        session.reader.join();
+        session.writer.join();
+    }
+
+#ifdef _WIN32
+    WSACleanup();
+#else
+    closesocket(listener);
+    unlink(address);
+#endif
+    ojsim_catalog_free(pCatalog);
+    return 0;
+}
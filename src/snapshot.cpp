@@ -0,0 +1,363 @@
+#include <onut/Sound.h>
+#include <onut/Texture.h>
+
+#include <cstring>
+
+#include "defines.h"
+#include "emitters.h"
+#include "part.h"
+#include "particle.h"
+#include "rng.h"
+#include "satellites.h"
+#include "snapshot.h"
+
+#define MAX_FLIGHT_SNAPSHOTS 16
+
+extern int gameState;
+extern float endTimer;
+extern bool hasStableOrbit;
+extern Vector2 cameraPos;
+extern float zoom;
+extern int stageCount;
+extern float scafoldingPos;
+extern float shakeAmount;
+extern std::vector<Vector2> plotPoints;
+
+struct SnapshotHeader
+{
+    int gameState;
+    float endTimer;
+    bool hasStableOrbit;
+    Vector2 cameraPos;
+    float zoom;
+    int stageCount;
+    float scafoldingPos;
+    float shakeAmount;
+    RandomStream physicsRandom;
+    int mainPart;
+    uint32_t partCount;
+    uint32_t stageListCount;
+    uint32_t stagedPartCount;
+    uint32_t particleCount;
+    uint32_t plotPointCount;
+    int satelliteCount;
+};
+
+struct PartRecord
+{
+    Vector2 position;
+    Vector2 vel;
+    float angle;
+    float angleVelocity;
+    float liquidFuel;
+    float solidFuel;
+    float totalMass;
+    Vector2 centerOfMass;
+    float speed;
+    float altitude;
+    int type;
+    int parent;
+    int parentAttachPoint;
+    uint32_t usedAttachPoints;
+    bool fixed;
+    bool isActive;
+    bool hasSound;
+};
+
+struct ParticleRecord
+{
+    Vector2 position;
+    Vector2 vel;
+    float life;
+    float duration;
+    Color colorFrom, colorTo;
+    float sizeFrom, sizeTo;
+    float angle;
+    float angleVel;
+    int texture;
+    int source; // Emitter def, for the budgets and ground collision
+};
+
+static std::vector<Snapshot> flightSnapshots;
+
+template<typename T>
+static void write(std::vector<uint8_t>& data, const T* pItems, size_t count)
+{
+    auto offset = data.size();
+    data.resize(offset + sizeof(T) * count);
+    memcpy(data.data() + offset, pItems, sizeof(T) * count);
+}
+
+template<typename T>
+static const T* read(const uint8_t*& pData, size_t count)
+{
+    auto pRet = (const T*)pData;
+    pData += sizeof(T) * count;
+    return pRet;
+}
+
+static void flattenParts(const Parts& parts, int parentIndex, std::vector<Part*>& flat, std::vector<int>& parents)
+{
+    for (auto pPart : parts)
+    {
+        int index = (int)flat.size();
+        flat.push_back(pPart);
+        parents.push_back(parentIndex);
+        flattenParts(pPart->children, index, flat, parents);
+    }
+}
+
+static int indexOf(const std::vector<Part*>& flat, Part* pPart)
+{
+    for (int i = 0; i < (int)flat.size(); ++i)
+    {
+        if (flat[i] == pPart) return i;
+    }
+    return -1;
+}
+
+void takeSnapshot(Snapshot& snapshot)
+{
+    auto& data = snapshot.data;
+    data.clear();
+    snapshot.textures.clear();
+
+    // Parents always come before their children
+    std::vector<Part*> flat;
+    std::vector<int> parents;
+    flattenParts(parts, -1, flat, parents);
+
+    uint32_t stagedPartCount = 0;
+    for (auto& stage : stages) stagedPartCount += (uint32_t)stage.size();
+
+    SnapshotHeader header;
+    header.gameState = gameState;
+    header.endTimer = endTimer;
+    header.hasStableOrbit = hasStableOrbit;
+    header.cameraPos = cameraPos;
+    header.zoom = zoom;
+    header.stageCount = stageCount;
+    header.scafoldingPos = scafoldingPos;
+    header.shakeAmount = shakeAmount;
+    header.physicsRandom = randomStreams[RANDOM_STREAM_PHYSICS];
+    header.mainPart = indexOf(flat, pMainPart);
+    header.partCount = (uint32_t)flat.size();
+    header.stageListCount = (uint32_t)stages.size();
+    header.stagedPartCount = stagedPartCount;
+    header.particleCount = (uint32_t)particles.count;
+    header.plotPointCount = (uint32_t)plotPoints.size();
+    header.satelliteCount = satelliteCatalog.size();
+    data.reserve(sizeof(SnapshotHeader) +
+                 sizeof(PartRecord) * flat.size() +
+                 sizeof(uint32_t) * (stages.size() + stagedPartCount) +
+                 sizeof(ParticleRecord) * particles.count +
+                 sizeof(Vector2) * plotPoints.size());
+    write(data, &header, 1);
+
+    for (int i = 0; i < (int)flat.size(); ++i)
+    {
+        auto pPart = flat[i];
+        PartRecord record;
+        record.position = pPart->position;
+        record.vel = pPart->vel;
+        record.angle = pPart->angle;
+        record.angleVelocity = pPart->angleVelocity;
+        record.liquidFuel = pPart->liquidFuel;
+        record.solidFuel = pPart->solidFuel;
+        record.totalMass = pPart->totalMass;
+        record.centerOfMass = pPart->centerOfMass;
+        record.speed = pPart->speed;
+        record.altitude = pPart->altitude;
+        record.type = pPart->type;
+        record.parent = parents[i];
+        record.parentAttachPoint = pPart->parentAttachPoint;
+        record.usedAttachPoints = 0;
+        for (auto attachPoint : pPart->usedAttachPoints) record.usedAttachPoints |= 1 << attachPoint;
+        record.fixed = pPart->fixed;
+        record.isActive = pPart->isActive;
+        record.hasSound = pPart->pSound != nullptr;
+        write(data, &record, 1);
+    }
+
+    for (auto& stage : stages)
+    {
+        auto size = (uint32_t)stage.size();
+        write(data, &size, 1);
+        for (auto pPart : stage)
+        {
+            auto index = (uint32_t)indexOf(flat, pPart);
+            write(data, &index, 1);
+        }
+    }
+
+    for (int p = 0; p < particles.count; ++p)
+    {
+        auto particle = getParticle(p);
+        ParticleRecord record;
+        record.position = particle.position;
+        record.vel = particle.vel;
+        record.life = particle.life;
+        record.duration = particle.duration;
+        record.colorFrom = particle.colorFrom;
+        record.colorTo = particle.colorTo;
+        record.sizeFrom = particle.sizeFrom;
+        record.sizeTo = particle.sizeTo;
+        record.angle = particle.angle;
+        record.angleVel = particle.angleVel;
+        record.source = particles.source[p];
+        record.texture = -1;
+        for (int i = 0; i < (int)snapshot.textures.size(); ++i)
+        {
+            if (snapshot.textures[i] == particle.pTexture)
+            {
+                record.texture = i;
+                break;
+            }
+        }
+        if (record.texture == -1)
+        {
+            record.texture = (int)snapshot.textures.size();
+            snapshot.textures.push_back(particle.pTexture);
+        }
+        write(data, &record, 1);
+    }
+
+    write(data, plotPoints.data(), plotPoints.size());
+}
+
+static void stopSounds(Parts& parts)
+{
+    for (auto pPart : parts)
+    {
+        if (pPart->pSound)
+        {
+            pPart->pSound->stop();
+            pPart->pSound = nullptr;
+        }
+        stopSounds(pPart->children);
+    }
+}
+
+void restoreSnapshot(const Snapshot& snapshot)
+{
+    if (snapshot.data.size() < sizeof(SnapshotHeader)) return;
+
+    stopSounds(parts);
+    toKill.clear();
+    deleteParts(parts);
+    stages.clear();
+
+    auto pData = snapshot.data.data();
+    auto& header = *read<SnapshotHeader>(pData, 1);
+    gameState = header.gameState;
+    endTimer = header.endTimer;
+    hasStableOrbit = header.hasStableOrbit;
+    cameraPos = header.cameraPos;
+    zoom = header.zoom;
+    stageCount = header.stageCount;
+    scafoldingPos = header.scafoldingPos;
+    shakeAmount = header.shakeAmount;
+    randomStreams[RANDOM_STREAM_PHYSICS] = header.physicsRandom;
+
+    // A payload deployed after the snapshot will deploy again
+    truncateSatelliteCatalog(header.satelliteCount);
+
+    std::vector<Part*> flat(header.partCount);
+    auto pRecords = read<PartRecord>(pData, header.partCount);
+    for (uint32_t i = 0; i < header.partCount; ++i)
+    {
+        auto& record = pRecords[i];
+        auto pPart = new Part();
+        pPart->position = record.position;
+        pPart->vel = record.vel;
+        pPart->angle = record.angle;
+        pPart->angleVelocity = record.angleVelocity;
+        pPart->liquidFuel = record.liquidFuel;
+        pPart->solidFuel = record.solidFuel;
+        pPart->totalMass = record.totalMass;
+        pPart->centerOfMass = record.centerOfMass;
+        pPart->speed = record.speed;
+        pPart->altitude = record.altitude;
+        pPart->type = record.type;
+        pPart->parentAttachPoint = record.parentAttachPoint;
+        for (int attachPoint = 0; attachPoint < 32; ++attachPoint)
+        {
+            if (record.usedAttachPoints & (1 << attachPoint)) pPart->usedAttachPoints.insert(attachPoint);
+        }
+        pPart->fixed = record.fixed;
+        pPart->isActive = record.isActive;
+        if (record.hasSound)
+        {
+            auto& partDef = partDefs[pPart->type];
+            pPart->pSound = OGetSound("LiquidEngineLoop.wav")->createInstance();
+            pPart->pSound->setVolume(partDef.burn);
+            pPart->pSound->setLoop(true);
+            pPart->pSound->play();
+        }
+        if (record.parent == -1)
+        {
+            parts.push_back(pPart);
+        }
+        else
+        {
+            pPart->pParent = flat[record.parent];
+            pPart->pParent->children.push_back(pPart);
+        }
+        flat[i] = pPart;
+    }
+    pMainPart = header.mainPart == -1 ? nullptr : flat[header.mainPart];
+    for (auto pPart : parts) attachEmitters(pPart);
+
+    stages.resize(header.stageListCount);
+    for (auto& stage : stages)
+    {
+        auto size = *read<uint32_t>(pData, 1);
+        auto pIndices = read<uint32_t>(pData, size);
+        stage.reserve(size);
+        for (uint32_t i = 0; i < size; ++i) stage.push_back(flat[pIndices[i]]);
+    }
+
+    clearParticles();
+    auto pParticles = read<ParticleRecord>(pData, header.particleCount);
+    for (uint32_t i = 0; i < header.particleCount; ++i)
+    {
+        auto& record = pParticles[i];
+        addParticle({
+            record.position,
+            record.vel,
+            record.life,
+            record.duration,
+            record.colorFrom, record.colorTo,
+            record.sizeFrom, record.sizeTo,
+            record.angle,
+            record.angleVel,
+            snapshot.textures[record.texture]
+        }, record.source);
+    }
+
+    auto pPlotPoints = read<Vector2>(pData, header.plotPointCount);
+    plotPoints.assign(pPlotPoints, pPlotPoints + header.plotPointCount);
+}
+
+void pushFlightSnapshot()
+{
+    if (flightSnapshots.size() >= MAX_FLIGHT_SNAPSHOTS)
+    {
+        flightSnapshots.erase(flightSnapshots.begin());
+    }
+    flightSnapshots.push_back({});
+    takeSnapshot(flightSnapshots.back());
+}
+
+bool popFlightSnapshot()
+{
+    if (flightSnapshots.empty()) return false;
+    restoreSnapshot(flightSnapshots.back());
+    flightSnapshots.pop_back();
+    return true;
+}
+
+void clearFlightSnapshots()
+{
+    flightSnapshots.clear();
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include <onut/ForwardDeclaration.h>
+#include <cstdint>
+#include <vector>
+
+OForwardDeclare(Texture);
+
+// Whole flight state packed in a flat buffer. Part trees and stages are
+// stored as indices, textures referenced by particles as a small table.
+struct Snapshot
+{
+    std::vector<uint8_t> data;
+    std::vector<OTextureRef> textures;
+};
+
+void takeSnapshot(Snapshot& snapshot);
+void restoreSnapshot(const Snapshot& snapshot);
+
+// Quick-save stack, one entry per stage activation
+void pushFlightSnapshot();
+bool popFlightSnapshot();
+void clearFlightSnapshots();
@@ -0,0 +1,108 @@
+#include <algorithm>
+#include <cmath>
+
+#include "physics.h"
+#include "terrain.h"
+
+#define TERRAIN_TWO_PI 6.283185307f
+#define TERRAIN_SAMPLES_PER_RADIAN ((float)TERRAIN_SAMPLES / TERRAIN_TWO_PI)
+#define TERRAIN_CLEAR_RADIUS_SQ ((PLANET_SIZE + TERRAIN_MAX_HEIGHT) * (PLANET_SIZE + TERRAIN_MAX_HEIGHT))
+#define TERRAIN_SOLID_RADIUS_SQ ((float)PLANET_SIZE * (float)PLANET_SIZE)
+
+// Launch pad is at the bottom of the planet in screen space
+#define LAUNCH_SITE_ANGLE (-TERRAIN_TWO_PI / 4)
+#define LAUNCH_SITE_FLAT 0.02f
+#define LAUNCH_SITE_BLEND 0.03f
+
+// One extra sample so interpolation never has to wrap
+static float heights[TERRAIN_SAMPLES + 1];
+static float slopes[TERRAIN_SAMPLES + 1];
+
+struct TerrainHarmonic
+{
+    float frequency;
+    float amplitude;
+    float phase;
+};
+
+static const TerrainHarmonic TERRAIN_HARMONICS[] = {
+    {3, 1.0f, 0.3f},
+    {7, .6f, 2.1f},
+    {13, .45f, 4.4f},
+    {29, .3f, 1.2f},
+    {61, .2f, 5.7f},
+    {127, .12f, 3.3f},
+    {251, .06f, .8f},
+};
+
+void initTerrain()
+{
+    float totalAmplitude = 0;
+    for (auto& harmonic : TERRAIN_HARMONICS) totalAmplitude += harmonic.amplitude;
+
+    for (int i = 0; i < TERRAIN_SAMPLES; ++i)
+    {
+        float angle = (float)i / TERRAIN_SAMPLES_PER_RADIAN;
+        float height = 0;
+        for (auto& harmonic : TERRAIN_HARMONICS)
+        {
+            height += harmonic.amplitude * (1 + std::sin(angle * harmonic.frequency + harmonic.phase)) * .5f;
+        }
+        height *= TERRAIN_MAX_HEIGHT / totalAmplitude;
+
+        // Flatten around the launch pad
+        float fromLaunchSite = std::fabs(std::remainder(angle - LAUNCH_SITE_ANGLE, TERRAIN_TWO_PI));
+        float blend = std::max(0.0f, std::min(1.0f, (fromLaunchSite - LAUNCH_SITE_FLAT) / LAUNCH_SITE_BLEND));
+        blend = blend * blend * (3 - 2 * blend);
+        heights[i] = height * blend;
+    }
+    heights[TERRAIN_SAMPLES] = heights[0];
+
+    // Height change per unit of surface length, per segment
+    float segmentLength = (float)PLANET_SIZE / TERRAIN_SAMPLES_PER_RADIAN;
+    for (int i = 0; i < TERRAIN_SAMPLES; ++i)
+    {
+        slopes[i] = (heights[i + 1] - heights[i]) / segmentLength;
+    }
+    slopes[TERRAIN_SAMPLES] = slopes[0];
+}
+
+float getTerrainHeight(float angle)
+{
+    float f = angle * TERRAIN_SAMPLES_PER_RADIAN;
+    float base = std::floor(f);
+    int i = (int)base & (TERRAIN_SAMPLES - 1);
+    return heights[i] + (heights[i + 1] - heights[i]) * (f - base);
+}
+
+float getSurfaceRadius(float angle)
+{
+    return (float)PLANET_SIZE + getTerrainHeight(angle);
+}
+
+void getTerrainNormal(float x, float y, float& normalX, float& normalY)
+{
+    float length = std::sqrt(x * x + y * y);
+    float upX = length > 0 ? x / length : 0;
+    float upY = length > 0 ? y / length : 0;
+    float f = std::atan2(y, x) * TERRAIN_SAMPLES_PER_RADIAN;
+    int i = (int)std::floor(f) & (TERRAIN_SAMPLES - 1);
+
+    // Tilted back along the tangent (-up.y, up.x) by the slope
+    normalX = upX + upY * slopes[i];
+    normalY = upY - upX * slopes[i];
+    length = std::sqrt(normalX * normalX + normalY * normalY);
+    normalX /= length;
+    normalY /= length;
+}
+
+bool isUnderground(float x, float y)
+{
+    // Almost everything is either well above the highest peak or below
+    // the lowest valley, only do the angular lookup in between.
+    float distSq = x * x + y * y;
+    if (distSq >= TERRAIN_CLEAR_RADIUS_SQ) return false;
+    if (distSq < TERRAIN_SOLID_RADIUS_SQ) return true;
+    float surface = getSurfaceRadius(std::atan2(y, x));
+    return distSq < surface * surface;
+}
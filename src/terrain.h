@@ -0,0 +1,13 @@
+#pragma once
+
+// Planet surface as a 1D heightmap indexed by angle (atan2(y, x)). Heights
+// are above PLANET_SIZE and never negative. No engine dependency, the
+// simulation library uses it too.
+#define TERRAIN_SAMPLES 4096 // Must be a power of 2
+#define TERRAIN_MAX_HEIGHT 60.0f
+
+void initTerrain();
+float getTerrainHeight(float angle);
+float getSurfaceRadius(float angle);
+void getTerrainNormal(float x, float y, float& normalX, float& normalY);
+bool isUnderground(float x, float y);
@@ -0,0 +1,22 @@
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+
+#include "textcache.h"
+
+const std::string& formatText(CachedText& cache, const char* format, ...)
+{
+    char buffer[CACHED_TEXT_CAPACITY];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (strcmp(buffer, cache.text.c_str())) cache.text.assign(buffer);
+    return cache.text;
+}
+
+CachedText& getCachedText(CachedTexts& caches, int index)
+{
+    if (index >= (int)caches.size()) caches.resize(index + 1);
+    return caches[index];
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <string>
+#include <vector>
+
+// HUD text without per frame allocations. Each call site keeps a CachedText,
+// formatText prints into a stack buffer and only touches the string when the
+// result changed. Its capacity is reserved once, so that never allocates
+// either.
+
+#define CACHED_TEXT_CAPACITY 256
+
+struct CachedText
+{
+    std::string text;
+
+    CachedText()
+    {
+        text.reserve(CACHED_TEXT_CAPACITY);
+    }
+};
+
+using CachedTexts = std::vector<CachedText>;
+
+const std::string& formatText(CachedText& cache, const char* format, ...);
+
+// For loops over stages or parts, grows only when more are needed
+CachedText& getCachedText(CachedTexts& caches, int index);
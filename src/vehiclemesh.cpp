@@ -0,0 +1,154 @@
+#include <onut/IndexBuffer.h>
+#include <onut/Renderer.h>
+#include <onut/Texture.h>
+#include <onut/VertexBuffer.h>
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+#include "meshes.h"
+#include "part.h"
+#include "renderqueue.h"
+#include "vehiclemesh.h"
+
+#define MAX_VEHICLE_QUADS 4096 // 16 bits indices
+
+struct VehicleSprite
+{
+    OTextureRef pTexture;
+    Matrix transform;
+};
+using VehicleSprites = std::vector<VehicleSprite>;
+
+struct VehicleDraw
+{
+    OTextureRef pTexture;
+    int layer;
+    int firstQuad;
+    int quadCount;
+};
+
+struct VehicleMesh
+{
+    OVertexBufferRef pVB;
+    std::vector<VehicleDraw> draws;
+    float radius = 0;
+};
+
+static std::unordered_map<Part*, VehicleMesh> vehicleMeshes; // By root part
+static OIndexBufferRef pVehicleIB;
+
+// Same order drawParts used to draw them in, decouplers and their engine
+// covers go after everything else
+static void collectSprites(Part* pPart, const Matrix& transform, Part* pParent, VehicleSprites& sprites, VehicleSprites& onTops)
+{
+    auto& partDef = partDefs[pPart->type];
+    auto spriteTransform = Matrix::CreateScale(1.0f / 64.0f) * transform;
+    if (partDef.type == PART_TYPE_DECOUPLER)
+    {
+        if (pParent)
+        {
+            auto& parentPartDef = partDefs[pParent->type];
+            if (parentPartDef.type == PART_TYPE_BOOSTER ||
+                parentPartDef.type == PART_TYPE_ENGINE)
+            {
+                onTops.push_back({partDef.pEngineCoverTexture, Matrix::CreateScale(1.0f / 64.0f) * Matrix::CreateTranslation(0, -.35f, 0) * transform});
+            }
+        }
+        onTops.push_back({partDef.pTexture, spriteTransform});
+    }
+    else
+    {
+        sprites.push_back({partDef.pTexture, spriteTransform});
+    }
+    for (auto pChild : pPart->children)
+    {
+        collectSprites(pChild, Matrix::CreateRotationZ(pChild->angle) * Matrix::CreateTranslation(pChild->position) * transform, pPart, sprites, onTops);
+    }
+}
+
+static void bakeVehicleMesh(Part* pRoot, VehicleMesh& mesh)
+{
+    VehicleSprites sprites;
+    VehicleSprites onTops;
+    collectSprites(pRoot, Matrix::Identity, nullptr, sprites, onTops);
+    auto coverCount = onTops.size();
+    sprites.insert(sprites.end(), onTops.begin(), onTops.end());
+    if (sprites.size() > MAX_VEHICLE_QUADS) sprites.resize(MAX_VEHICLE_QUADS);
+
+    // Centered on the texture like drawSprite does
+    std::vector<Mesh::Vertex> vertices;
+    vertices.reserve(sprites.size() * 4);
+    for (int i = 0; i < (int)sprites.size(); ++i)
+    {
+        auto& sprite = sprites[i];
+        int layer = i < (int)(sprites.size() - coverCount) ? RENDER_LAYER_VEHICLES : RENDER_LAYER_VEHICLE_COVERS;
+        auto halfSize = sprite.pTexture->getSizef() * .5f;
+        vertices.push_back({Vector2::Transform(Vector2(-halfSize.x, -halfSize.y), sprite.transform), Vector2(0, 0), Color::White});
+        vertices.push_back({Vector2::Transform(Vector2(-halfSize.x, halfSize.y), sprite.transform), Vector2(0, 1), Color::White});
+        vertices.push_back({Vector2::Transform(Vector2(halfSize.x, halfSize.y), sprite.transform), Vector2(1, 1), Color::White});
+        vertices.push_back({Vector2::Transform(Vector2(halfSize.x, -halfSize.y), sprite.transform), Vector2(1, 0), Color::White});
+        for (auto it = vertices.end() - 4; it != vertices.end(); ++it)
+        {
+            mesh.radius = std::max(mesh.radius, it->position.Length());
+        }
+        if (!mesh.draws.empty() && mesh.draws.back().pTexture == sprite.pTexture && mesh.draws.back().layer == layer)
+        {
+            ++mesh.draws.back().quadCount;
+        }
+        else
+        {
+            mesh.draws.push_back({sprite.pTexture, layer, (int)(vertices.size() / 4) - 1, 1});
+        }
+    }
+    mesh.pVB = OVertexBuffer::createStatic(vertices.data(), (uint32_t)(vertices.size() * sizeof(Mesh::Vertex)));
+}
+
+static VehicleMesh& getVehicleMesh(Part* pRoot)
+{
+    auto it = vehicleMeshes.find(pRoot);
+    if (it == vehicleMeshes.end())
+    {
+        it = vehicleMeshes.insert({pRoot, VehicleMesh()}).first;
+        bakeVehicleMesh(pRoot, it->second);
+    }
+    return it->second;
+}
+
+float getVehicleMeshRadius(Part* pRoot)
+{
+    return getVehicleMesh(pRoot).radius;
+}
+
+void drawVehicleMesh(Part* pRoot, const Matrix& transform)
+{
+    if (!pVehicleIB)
+    {
+        std::vector<uint16_t> indices(MAX_VEHICLE_QUADS * 6);
+        for (int i = 0; i < MAX_VEHICLE_QUADS; ++i)
+        {
+            auto pIndex = indices.data() + i * 6;
+            pIndex[0] = i * 4; pIndex[1] = i * 4 + 1; pIndex[2] = i * 4 + 2;
+            pIndex[3] = i * 4; pIndex[4] = i * 4 + 2; pIndex[5] = i * 4 + 3;
+        }
+        pVehicleIB = OIndexBuffer::createStatic(indices.data(), (uint32_t)(indices.size() * sizeof(uint16_t)));
+    }
+
+    auto& mesh = getVehicleMesh(pRoot);
+
+    for (auto& draw : mesh.draws)
+    {
+        queueDraw(draw.layer, OBlendPreMultiplied, draw.pTexture, mesh.pVB, pVehicleIB, transform, draw.firstQuad * 6, draw.quadCount * 6);
+    }
+}
+
+void invalidateVehicleMesh(Part* pPart)
+{
+    vehicleMeshes.erase(getTopParent(pPart));
+}
+
+void invalidateVehicleMeshes()
+{
+    vehicleMeshes.clear();
+}
@@ -0,0 +1,14 @@
+#pragma once
+#include <onut/Maths.h>
+
+struct Part;
+
+// Each vehicle's sprites, decoupler covers already layered on top, baked in
+// its root part's space. Drawing it queues one command per run of sprites
+// sharing a texture, all with the same transform, see renderqueue.h. The
+// bake is dropped whenever the tree changes and redone on the next draw.
+
+void drawVehicleMesh(Part* pRoot, const Matrix& transform);
+float getVehicleMeshRadius(Part* pRoot); // Around the root's origin
+void invalidateVehicleMesh(Part* pPart); // Any part of the vehicle
+void invalidateVehicleMeshes();
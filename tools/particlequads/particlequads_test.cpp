@@ -0,0 +1,251 @@
+// Checks the particle quad kernel against a straightforward reference, then
+// times it on 100k particles. Built once per path by the Makefile next to
+// this file, the kernel picks SSE2 or scalar at compile time.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "particlequads.h"
+
+#define TEST_COUNT 20000
+#define TEST_CLASSES 40
+#define TEST_CHUNK_SIZE 4096
+#define BENCH_COUNT 100000
+#define BENCH_RUNS 50
+
+struct TestParticles
+{
+    std::vector<float> positionX, positionY, life;
+    std::vector<uint16_t> angle, particleClass;
+    std::vector<ParticleQuadClass> classes;
+    std::vector<uint8_t> visible;   // Empty when nothing is culled
+
+    ParticleQuadInput getInput() const
+    {
+        return {(int)life.size(), positionX.data(), positionY.data(), life.data(),
+                angle.data(), particleClass.data(), classes.data(),
+                visible.empty() ? nullptr : visible.data()};
+    }
+
+    bool isVisible(int i) const
+    {
+        return visible.empty() || visible[i];
+    }
+};
+
+static uint32_t rng = 1;
+
+static float randFloat(float from, float to)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return from + (to - from) * (float)(rng >> 8) / 16777216.0f;
+}
+
+static void makeParticles(TestParticles& particles, int count)
+{
+    particles.classes.resize(TEST_CLASSES);
+    for (int i = 0; i < TEST_CLASSES; ++i)
+    {
+        auto& quadClass = particles.classes[i];
+        for (int c = 0; c < 4; ++c)
+        {
+            quadClass.colorFrom[c] = randFloat(0, 1);
+            quadClass.colorDelta[c] = randFloat(-1, 1);
+        }
+        quadClass.halfSizeFrom = randFloat(.1f, 4);
+        quadClass.halfSizeDelta = randFloat(-.1f, 8);
+        quadClass.aspect = randFloat(.5f, 2);
+        quadClass.textureSlot = (i * 7) % PARTICLE_QUAD_MAX_TEXTURES;
+    }
+    for (int i = 0; i < count; ++i)
+    {
+        // Around the planet's surface, where positions are largest
+        particles.positionX.push_back(randFloat(-11000, 11000));
+        particles.positionY.push_back(randFloat(-11000, 11000));
+        particles.life.push_back(randFloat(0, 1));
+        particles.angle.push_back((uint16_t)randFloat(0, 65536));
+        particles.particleClass.push_back((uint16_t)randFloat(0, TEST_CLASSES));
+    }
+}
+
+// Sorted by texture, in particle order within a texture, exact sin and cos
+static void buildReference(const TestParticles& particles, std::vector<ParticleQuadVertex>& vertices)
+{
+    for (int slot = 0; slot < PARTICLE_QUAD_MAX_TEXTURES; ++slot)
+    {
+        for (int i = 0; i < (int)particles.life.size(); ++i)
+        {
+            auto& quadClass = particles.classes[particles.particleClass[i]];
+            if (quadClass.textureSlot != slot || !particles.isVisible(i)) continue;
+            double life = particles.life[i];
+            double angle = particles.angle[i] / 65536.0 * 6.283185307179586;
+            double halfWidth = quadClass.halfSizeFrom + quadClass.halfSizeDelta * life;
+            double halfHeight = halfWidth * quadClass.aspect;
+            double ax = halfWidth * std::cos(angle), ay = halfWidth * std::sin(angle);
+            double bx = -halfHeight * std::sin(angle), by = halfHeight * std::cos(angle);
+            float color[4];
+            for (int c = 0; c < 4; ++c) color[c] = (float)(quadClass.colorFrom[c] + quadClass.colorDelta[c] * life);
+            double x = particles.positionX[i];
+            double y = particles.positionY[i];
+            const double corners[4][4] = {
+                {x - ax - bx, y - ay - by, 0, 0},
+                {x - ax + bx, y - ay + by, 0, 1},
+                {x + ax + bx, y + ay + by, 1, 1},
+                {x + ax - bx, y + ay - by, 1, 0},
+            };
+            for (auto& corner : corners)
+            {
+                vertices.push_back({(float)corner[0], (float)corner[1], (float)corner[2], (float)corner[3],
+                                    color[0], color[1], color[2], color[3]});
+            }
+        }
+    }
+}
+
+static int compare(const std::vector<ParticleQuadVertex>& reference, const ParticleQuadVertex* pVertices, const char* name)
+{
+    // The kernel's table truncates to 4096 angle steps, up to a step of error
+    // on the largest corner (half size 12 by 24), plus float rounding
+    const float POSITION_TOLERANCE = 26.84f * 6.2832f / 4096 + .002f;
+    const float COLOR_TOLERANCE = 1e-5f;
+    int errors = 0;
+    for (int v = 0; v < (int)reference.size(); ++v)
+    {
+        auto& expected = reference[v];
+        auto& actual = pVertices[v];
+        bool isMatch =
+            std::fabs(actual.x - expected.x) <= POSITION_TOLERANCE &&
+            std::fabs(actual.y - expected.y) <= POSITION_TOLERANCE &&
+            actual.u == expected.u && actual.v == expected.v &&
+            std::fabs(actual.r - expected.r) <= COLOR_TOLERANCE &&
+            std::fabs(actual.g - expected.g) <= COLOR_TOLERANCE &&
+            std::fabs(actual.b - expected.b) <= COLOR_TOLERANCE &&
+            std::fabs(actual.a - expected.a) <= COLOR_TOLERANCE;
+        if (!isMatch && errors++ < 5)
+        {
+            printf("%s: vertex %i is (%f, %f, %f, %f), expected (%f, %f, %f, %f)\n", name, v,
+                   actual.x, actual.y, actual.u, actual.v, expected.x, expected.y, expected.u, expected.v);
+        }
+    }
+    return errors;
+}
+
+static int checkBatches(const TestParticles& particles, const ParticleQuadBatch* pBatches, int batchCount, const char* name)
+{
+    int counts[PARTICLE_QUAD_MAX_TEXTURES] = {0};
+    for (int i = 0; i < (int)particles.particleClass.size(); ++i)
+    {
+        if (particles.isVisible(i)) ++counts[particles.classes[particles.particleClass[i]].textureSlot];
+    }
+    int quad = 0;
+    int batch = 0;
+    for (int slot = 0; slot < PARTICLE_QUAD_MAX_TEXTURES; ++slot)
+    {
+        if (!counts[slot]) continue;
+        if (batch >= batchCount || pBatches[batch].textureSlot != slot ||
+            pBatches[batch].firstQuad != quad || pBatches[batch].quadCount != counts[slot])
+        {
+            printf("%s: batch %i doesn't match texture %i\n", name, batch, slot);
+            return 1;
+        }
+        quad += counts[slot];
+        ++batch;
+    }
+    if (batch != batchCount)
+    {
+        printf("%s: %i batches, expected %i\n", name, batchCount, batch);
+        return 1;
+    }
+    return 0;
+}
+
+static int test()
+{
+    TestParticles particles;
+    makeParticles(particles, TEST_COUNT);
+    auto input = particles.getInput();
+    std::vector<ParticleQuadVertex> reference;
+    buildReference(particles, reference);
+
+    PARTICLE_QUAD_ALIGN static ParticleQuadVertex vertices[TEST_COUNT * 4];
+    ParticleQuadBatch batches[PARTICLE_QUAD_MAX_TEXTURES];
+    int errors = 0;
+
+    // In one go
+    int batchCount = buildParticleQuads(input, vertices, batches);
+    errors += checkBatches(particles, batches, batchCount, "buildParticleQuads");
+    errors += compare(reference, vertices, "buildParticleQuads");
+
+    // In chunks, the way drawParticles splits it across threads
+    std::fill(vertices, vertices + TEST_COUNT * 4, ParticleQuadVertex());
+    int chunkCount = (TEST_COUNT + TEST_CHUNK_SIZE - 1) / TEST_CHUNK_SIZE;
+    std::vector<int> chunkCounts(chunkCount * PARTICLE_QUAD_MAX_TEXTURES, 0);
+    int totals[PARTICLE_QUAD_MAX_TEXTURES] = {0};
+    for (int chunk = 0; chunk < chunkCount; ++chunk)
+    {
+        int first = chunk * TEST_CHUNK_SIZE;
+        countParticleQuads(input, first, std::min(TEST_CHUNK_SIZE, TEST_COUNT - first), &chunkCounts[chunk * PARTICLE_QUAD_MAX_TEXTURES]);
+        for (int slot = 0; slot < PARTICLE_QUAD_MAX_TEXTURES; ++slot) totals[slot] += chunkCounts[chunk * PARTICLE_QUAD_MAX_TEXTURES + slot];
+    }
+    int offsets[PARTICLE_QUAD_MAX_TEXTURES];
+    batchCount = getParticleQuadBatches(totals, offsets, batches);
+    for (int chunk = 0; chunk < chunkCount; ++chunk)
+    {
+        int first = chunk * TEST_CHUNK_SIZE;
+        int chunkOffsets[PARTICLE_QUAD_MAX_TEXTURES];
+        for (int slot = 0; slot < PARTICLE_QUAD_MAX_TEXTURES; ++slot)
+        {
+            chunkOffsets[slot] = offsets[slot];
+            offsets[slot] += chunkCounts[chunk * PARTICLE_QUAD_MAX_TEXTURES + slot];
+        }
+        writeParticleQuads(input, first, std::min(TEST_CHUNK_SIZE, TEST_COUNT - first), chunkOffsets, vertices);
+    }
+    errors += checkBatches(particles, batches, batchCount, "chunked");
+    errors += compare(reference, vertices, "chunked");
+
+    // Every third particle culled
+    particles.visible.resize(TEST_COUNT);
+    for (int i = 0; i < TEST_COUNT; ++i) particles.visible[i] = i % 3 ? 1 : 0;
+    input = particles.getInput();
+    reference.clear();
+    buildReference(particles, reference);
+    batchCount = buildParticleQuads(input, vertices, batches);
+    errors += checkBatches(particles, batches, batchCount, "culled");
+    errors += compare(reference, vertices, "culled");
+
+    printf("%i particles, %i batches: %s\n", TEST_COUNT, batchCount, errors ? "FAILED" : "passed");
+    return errors;
+}
+
+static void bench()
+{
+    TestParticles particles;
+    makeParticles(particles, BENCH_COUNT);
+    auto input = particles.getInput();
+    PARTICLE_QUAD_ALIGN static ParticleQuadVertex vertices[BENCH_COUNT * 4];
+    ParticleQuadBatch batches[PARTICLE_QUAD_MAX_TEXTURES];
+
+    std::vector<double> times;
+    for (int run = 0; run < BENCH_RUNS; ++run)
+    {
+        auto start = std::chrono::steady_clock::now();
+        buildParticleQuads(input, vertices, batches);
+        times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    std::sort(times.begin(), times.end());
+    printf("%i particles, one thread: median %.3f ms, best %.3f ms over %i runs\n",
+           BENCH_COUNT, times[times.size() / 2], times[0], BENCH_RUNS);
+}
+
+int main()
+{
+    if (test()) return 1;
+    bench();
+    return 0;
+}